@@ -0,0 +1,109 @@
+#!/bin/sh
+#
+# bench.sh - time lddgraph on synthetic ldd -v corpora and system binaries
+#
+# Run by make bench. For each corpus size, lddcorpus writes the ldd -v
+# output of a root loading that many objects, and lddgraph --stats graphs
+# it, best of BENCH_RUNS runs, timing parsing (Parser::parse), trimming
+# (finalize) and writing the DOT graph (print_output). The time per node
+# should stay flat as the corpus grows; if the largest corpus costs more
+# than BENCH_GROWTH times as much per node as the smallest, some lookup has
+# turned quadratic and the bench fails. The system binaries give real
+# world figures for the direct reader and for ldd, which are not checked.
+#
+# Environment:
+#   BENCH_SIZES    corpus sizes in objects (default "1000 4000 16000")
+#   BENCH_EDGES    objects needed by each object (default 4)
+#   BENCH_LABELS   version labels on each need (default 3)
+#   BENCH_RUNS     runs per measurement, the fastest is kept (default 3)
+#   BENCH_GROWTH   allowed growth of the time per node (default 3)
+#   BENCH_DIRS     directories of system binaries (default "/usr/bin /usr/sbin")
+#   BENCH_DIR      where to create the corpora (default bench/out)
+
+LDDGRAPH=${LDDGRAPH:-./lddgraph}
+LDDCORPUS=${LDDCORPUS:-bench/lddcorpus}
+BENCH_SIZES=${BENCH_SIZES:-"1000 4000 16000"}
+BENCH_EDGES=${BENCH_EDGES:-4}
+BENCH_LABELS=${BENCH_LABELS:-3}
+BENCH_RUNS=${BENCH_RUNS:-3}
+BENCH_GROWTH=${BENCH_GROWTH:-3}
+BENCH_DIRS=${BENCH_DIRS:-"/usr/bin /usr/sbin"}
+BENCH_DIR=${BENCH_DIR:-bench/out}
+
+mkdir -p "$BENCH_DIR" || exit 1
+
+# print the fastest of BENCH_RUNS runs of lddgraph with the given arguments
+# as: parse finalize emit nodes edges wall
+measure()
+{
+    run=0
+    while [ $run -lt "$BENCH_RUNS" ]
+    do
+        "$LDDGRAPH" --stats "$@" 2>&1 >/dev/null | awk '
+            / total: / {
+                for (i = 3; i < NF; i += 2) s[$i] = $(i + 1)
+            }
+            /^stats: wall / { wall = $3 }
+            END {
+                sub("s$", "", s["parse"]); sub("s$", "", s["finalize"])
+                sub("s$", "", s["emit"]); sub("s$", "", wall)
+                print s["parse"], s["finalize"], s["emit"], s["nodes"],
+                    s["edges"], wall
+            }'
+        run=$((run + 1))
+    done | sort -n -k 6 | head -n 1
+}
+
+printf '%-24s %8s %8s %10s %10s %10s %10s %10s\n' input nodes edges \
+    parse finalize emit wall us/node
+
+# print a row of the table from the name and the figures measure gave
+report()
+{
+    echo "$2" | awk -v name="$1" '{
+        printf "%-24s %8d %8d %10.6f %10.6f %10.6f %10.6f %10.3f\n",
+            name, $4, $5, $1, $2, $3, $6, ($4 > 0 ? $6 * 1e6 / $4 : 0)
+    }'
+}
+
+# print the wall time per node in microseconds from the figures measure gave
+per_node()
+{
+    echo "$1" | awk '{ print ($4 > 0 ? $6 * 1e6 / $4 : 0) }'
+}
+
+first=
+last=
+for size in $BENCH_SIZES
+do
+    corpus="$BENCH_DIR/synth-$size.ldd"
+
+    "$LDDCORPUS" -n "$size" -e "$BENCH_EDGES" -v "$BENCH_LABELS" \
+        > "$corpus" || exit 1
+
+    figures=$(measure "$corpus")
+    report "synthetic $size" "$figures"
+    per=$(per_node "$figures")
+    first=${first:-$per}
+    last=$per
+done
+
+list="$BENCH_DIR/system.list"
+find $BENCH_DIRS -maxdepth 1 -type f -perm -u+x 2>/dev/null | sort > "$list"
+count=$(wc -l < "$list")
+
+if [ "$count" -gt 0 ]
+then
+    report "system $count native" "$(measure -f "$list")"
+    report "system $count ldd" "$(measure -l -f "$list")"
+fi
+
+if awk -v a="$first" -v b="$last" -v g="$BENCH_GROWTH" \
+    'BEGIN { exit !(a > 0 && b > a * g) }'
+then
+    echo "bench: time per node grew from ${first}us to ${last}us," \
+        "more than ${BENCH_GROWTH} times" >&2
+    exit 1
+fi
+
+exit 0
@@ -0,0 +1,266 @@
+/*
+ * NAME
+ *   lddcorpus - generate synthetic ldd -v output for benchmarking lddgraph
+ *
+ * SYNOPSIS
+ *   lddcorpus [-n objects] [-e edges] [-v labels] [-r roots] [-s seed]
+ *
+ * DESCRIPTION
+ *   Write to stdout the ldd -v output of an imaginary executable loading
+ *   a given number of shared objects. Each object needs the next one, so
+ *   all are loaded, and a number of others picked at random, favouring the
+ *   objects at the end of the load order much as libc, libm and libpthread
+ *   are favoured on real systems. Each of these needs requires a number of
+ *   symbol versions of the object needed, giving the Version information
+ *   lines their labels.
+ *
+ *   With more than one root the documents follow each other, as lddgraph
+ *   -m reads them. The same seed always gives the same output.
+ *
+ * OPTIONS
+ *   -n N   shared objects loaded by each root (default 1000)
+ *   -e N   objects needed by each object, with versions, at most
+ *          (default 4)
+ *   -v N   version labels on each need (default 3)
+ *   -r N   roots, each a document of its own (default 1)
+ *   -s N   random seed (default 1)
+ *
+ * EXAMPLES
+ *   lddcorpus -n 16000 > big.ldd; lddgraph --stats big.ldd > /dev/null
+ *   lddcorpus -n 100 -r 50 > many.ldd; lddgraph -m many.ldd > /dev/null
+ *
+ * SEE ALSO
+ *   lddgraph(1), ldd(8)
+ */
+
+// C++ APIs
+#include <algorithm>            // std::find
+#include <iostream>             // std::cout, cerr, endl
+#include <string>               // std::string
+#include <vector>               // std::vector
+
+// C APIs
+#include <stdio.h>              // snprintf
+#include <stdlib.h>             // strtoul, exit, EXIT_FAILURE
+#include <unistd.h>             // getopt
+
+/*************************
+ *  Random numbers
+ *************************/
+
+// a 64 bit linear congruential generator, so the corpus depends only on
+// the seed and not on the C library
+class Random
+{
+ private:
+    unsigned long long state;
+
+ public:
+    Random(unsigned long long seed)
+    {
+        state = seed * 2862933555777941757ULL + 3037000493ULL;
+    };
+
+    // uniform in [0, 1)
+    double next(void)
+    {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+
+        return (state >> 11) * (1.0 / 9007199254740992.0);
+    };
+};
+
+/*************************
+ *  Corpus
+ *************************/
+
+class Corpus
+{
+ private:
+    unsigned long objects;
+    unsigned long edges;
+    unsigned long labels;
+    std::string out;            // the document being built
+
+    void soname(unsigned long i)
+    {
+        char s[64];
+
+        snprintf(s, sizeof(s), "libsynth%lu.so.1", i);
+        out += s;
+    };
+
+    void path(unsigned long i)
+    {
+        out += "/usr/lib/synth/";
+        soname(i);
+    };
+
+    // the object i needs: the next one, then others at random, more often
+    // those at the end of the load order
+    unsigned long needed(unsigned long i, unsigned long k, Random & random)
+    {
+        unsigned long span = objects - i - 1;
+        double u = random.next();
+
+        return k == 0 ? i + 1 : objects - 1 - (unsigned long)(span * u * u);
+    };
+
+    // one line per version label of an edge into object j
+    void need(unsigned long j, Random & random)
+    {
+        unsigned long first = (unsigned long)(random.next() * labels);
+
+        for (unsigned long l = 0; l < labels; l++)
+        {
+            char s[64];
+
+            out += "\t\t";
+            soname(j);
+            snprintf(s, sizeof(s), " (SYNTH%lu_1.%lu) => ", j, first + l);
+            out += s;
+            path(j);
+            out += "\n";
+        }
+    };
+
+ public:
+    Corpus(unsigned long n, unsigned long e, unsigned long v)
+    {
+        objects = n;
+        edges = e;
+        labels = v;
+    };
+
+    void write(unsigned long root, Random & random)
+    {
+        char s[64];
+
+        out.clear();
+
+        // the objects loaded, as ldd lists them at the top
+        for (unsigned long i = 0; i < objects; i++)
+        {
+            snprintf(s, sizeof(s), " (0x%016llx)\n",
+                0x7f0000000000ULL + i * 0x200000ULL);
+            out += "\t";
+            soname(i);
+            out += " => ";
+            path(i);
+            out += s;
+        }
+
+        out += "\t/lib64/ld-linux-x86-64.so.2 (0x00007f7fffffe000)\n";
+        out += "\n\tVersion information:\n";
+
+        // the root needs the first object
+        snprintf(s, sizeof(s), "\t/usr/bin/synth%lu:\n", root);
+        out += s;
+
+        if (objects > 0)
+        {
+            need(0, random);
+        }
+
+        for (unsigned long i = 0; i < objects; i++)
+        {
+            out += "\t";
+            path(i);
+            out += ":\n";
+
+            // ldd -v lists each object needed once
+            std::vector < unsigned long >done;
+
+            for (unsigned long k = 0; k < edges && i + 1 < objects; k++)
+            {
+                unsigned long j = needed(i, k, random);
+
+                if (std::find(done.begin(), done.end(), j) == done.end())
+                {
+                    done.push_back(j);
+                    need(j, random);
+                }
+            }
+        }
+
+        std::cout << out;
+    };
+};
+
+/*************************
+ *  Main
+ *************************/
+
+static void usage(void)
+{
+    std::cerr <<
+        "usage: lddcorpus [-n objects] [-e edges] [-v labels] [-r roots] "
+        "[-s seed]" << std::endl;
+    exit(EXIT_FAILURE);
+}
+
+static unsigned long number(const char *arg)
+{
+    char *end;
+    unsigned long n = strtoul(arg, &end, 10);
+
+    if (*arg == '\0' || *end != '\0')
+    {
+        usage();
+    }
+
+    return n;
+}
+
+int main(int ac, char **av)
+{
+    unsigned long objects = 1000;
+    unsigned long edges = 4;
+    unsigned long labels = 3;
+    unsigned long roots = 1;
+    unsigned long seed = 1;
+    int c;
+
+    std::ios::sync_with_stdio(false);
+
+    while ((c = getopt(ac, av, "n:e:v:r:s:?")) != -1)
+    {
+        switch (c)
+        {
+            case 'n':
+                objects = number(optarg);
+                break;
+            case 'e':
+                edges = number(optarg);
+                break;
+            case 'v':
+                labels = number(optarg);
+                break;
+            case 'r':
+                roots = number(optarg);
+                break;
+            case 's':
+                seed = number(optarg);
+                break;
+            default:
+                usage();
+        }
+    }
+
+    if (optind != ac || labels == 0)
+    {
+        usage();
+    }
+
+    Random random(seed);
+    Corpus corpus(objects, edges, labels);
+
+    for (unsigned long r = 0; r < roots; r++)
+    {
+        corpus.write(r, random);
+    }
+
+    std::cout.flush();
+
+    return std::cout.good() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
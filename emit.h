@@ -0,0 +1,233 @@
+/*
+ * emit.h - lddgraph's emitters: the output formats a graph is written
+ * in, and the sinks writing each graph as it is read or gathering the
+ * union of them all
+ */
+
+/*
+ * Copyright 2021 James Perkins
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef LDDGRAPH_EMIT_H
+#define LDDGRAPH_EMIT_H
+
+// C++ APIs
+#include <iostream>             // std::ostream
+#include <map>                  // std::map
+#include <sstream>              // std::ostringstream
+#include <string>               // std::string
+
+// C APIs
+#include <stdlib.h>             // realpath, free
+
+#include "graph.h"
+
+namespace lddgraph
+{
+
+/*************************
+ *  Output formats
+ *************************/
+
+// graph output formats
+enum Format
+{ FORMAT_DOT, FORMAT_BINARY, FORMAT_JSON, FORMAT_TSV };
+
+// look up an output format by name
+bool parse_format(const std::string & name, Format & format);
+
+// describe an input's graph for the info block
+std::string info_label(std::string & path, Nodes & nodes, Edges & edges);
+
+// write a graph as a graphviz DOT digraph, with an info block
+void print_output(std::ostream & out, std::string info, Nodes & nodes,
+    Edges & edges);
+
+// write a graph as a binary graph file record, as read back as an input
+void write_binary(std::ostream & out, const std::string & path,
+    Nodes & nodes, Edges & edges);
+
+// write a graph as a JSON object on one line
+void write_json(std::ostream & out, const std::string & path, Nodes & nodes,
+    Edges & edges);
+
+// write a graph as tab separated edges, one per line
+void write_tsv(std::ostream & out, const std::string & path, Edges & edges);
+
+// emit a graph in the selected output format
+void print_graph(std::ostream & out, Format format, std::string & path,
+    std::string info, Nodes & nodes, Edges & edges);
+
+/*************************
+ *  Emitting sinks
+ *************************/
+
+// PrintSink emits each graph as it is received
+class PrintSink:public GraphSink
+{
+ private:
+    std::ostream & out;
+    Format format;
+
+ public:
+    PrintSink(std::ostream & o, Format f):out(o), format(f)
+    {
+    };
+
+    void add(std::string & path, Nodes & nodes, Edges & edges)
+    {
+        print_graph(out, format, path, info_label(path, nodes, edges), nodes,
+            edges);
+    };
+};
+
+// Graph is the union of the graphs of many inputs, with one node per
+// canonical path and one edge per pair of nodes carrying every label
+// seen on it
+class Graph:public GraphSink
+{
+ private:
+    Nodes nodes;
+    Edges edges;
+    std::map < unsigned int, Node * >node_index;       // by canonical path
+    std::map < std::pair < Node *, Node * >, Edge * >edge_index;
+    std::map < std::string, std::string > canonical_paths;
+    std::string info;           // per-root summary
+
+    // resolve paths of files to their canonical form, leaving virtual
+    // nodes (e.g. "not found", linux-vdso.so.1) and missing files as is
+    std::string canonical(const std::string & path, bool is_root)
+    {
+        if (!is_root && path.find('/') == std::string::npos)
+        {
+            return path;
+        }
+
+        std::map < std::string, std::string >::iterator pc =
+            canonical_paths.find(path);
+
+        if (pc != canonical_paths.end())
+        {
+            return pc->second;
+        }
+
+        char *real = realpath(path.c_str(), NULL);
+        std::string canon(real != NULL ? real : path);
+
+        free(real);
+        canonical_paths[path] = canon;
+
+        return canon;
+    };
+
+    // the merged node for a path, taking its cost, load order and
+    // startup profile from the first input which has them
+    Node *intern_node(Node * node, bool is_root)
+    {
+        std::string path(canonical(node->getPath(), is_root));
+        Node *&merged = node_index[intern_string(path)];
+
+        if (merged == NULL)
+        {
+            merged = nodes.add(path);
+            merged->setCost(node->getCost());
+        }
+
+        if (merged->getLoadOrder() < 0)
+        {
+            merged->setLoadOrder(node->getLoadOrder());
+        }
+
+        if (merged->getProfile().runs == 0)
+        {
+            merged->setProfile(node->getProfile());
+        }
+
+        return merged;
+    };
+
+ public:
+    // add the graph of one input, rooted at its first node
+    void merge(std::string & path, Nodes & n, Edges & e)
+    {
+        std::map < Node *, Node * >merged_nodes;
+
+        for (Nodes::iterator pn = n.begin(); pn != n.end(); ++pn)
+        {
+            merged_nodes[*pn] = intern_node(*pn, pn == n.begin());
+        }
+
+        for (Edges::iterator pe = e.begin(); pe != e.end(); ++pe)
+        {
+            Node *from = merged_nodes[(*pe)->getFrom()];
+            Node *to = merged_nodes[(*pe)->getTo()];
+            Edge *&merged = edge_index[std::make_pair(from, to)];
+
+            if (merged == NULL)
+            {
+                merged = edges.add(from, to);
+            }
+
+            // the bound symbols and load order come from the first input
+            // with them; adding them up would count the symbols of an
+            // edge shared by many roots once for each
+            if (merged->hasSymbols())
+            {
+                merged->mergeLabels(*pe);
+            }
+            else
+            {
+                merged->merge(*pe);
+            }
+        }
+
+        info += info_label(path, n, e) + "\\n";
+    };
+
+    void add(std::string & path, Nodes & nodes, Edges & edges)
+    {
+        merge(path, nodes, edges);
+    };
+
+    Nodes & getNodes(void)
+    {
+        return nodes;
+    };
+
+    Edges & getEdges(void)
+    {
+        return edges;
+    };
+
+    std::string getInfo(void)
+    {
+        std::ostringstream s;
+
+        s << info << "merged nodes: " << nodes.size() << "\\n" <<
+            "merged edges: " << edges.size();
+
+        return s.str();
+    };
+};
+
+}                               // namespace lddgraph
+
+#endif
@@ -0,0 +1,567 @@
+/*
+ * graph.h - lddgraph's graph model: the nodes and edges of the graph of
+ * each document read, and the sinks the graphs are passed on to
+ */
+
+/*
+ * Copyright 2021 James Perkins
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef LDDGRAPH_GRAPH_H
+#define LDDGRAPH_GRAPH_H
+
+// C++ APIs
+#include <algorithm>            // std::find, std::min
+#include <string>               // std::string
+#include <vector>               // std::vector
+
+// C APIs
+#include <stdint.h>             // uint64_t
+
+namespace lddgraph
+{
+
+/*************************
+ *  Strings
+ *************************/
+
+// node paths, edge labels and symbol names are interned once each, for the
+// life of the process, as compact ids; interning a new string throws
+// InputError if the table is full
+unsigned int intern_string(const std::string & s);
+
+// the string of an id handed out by intern_string
+const std::string & interned_string(unsigned int id);
+
+template < class T > class Arena;
+
+/*************************
+ *  Node
+ *************************/
+
+// LoadCost is the work ld.so does to load and relocate an object
+struct LoadCost
+{
+    bool measured;              // read from the object
+    uint64_t relative;          // relocations needing no symbol
+    uint64_t symbolic;          // relocations needing a symbol lookup
+    uint64_t plt;               // DT_JMPREL relocations
+    uint64_t lookups;           // symbol lookups at startup
+    bool bind_now;              // DF_BIND_NOW, DF_1_NOW or DT_BIND_NOW
+    bool prelinked;             // DT_GNU_PRELINKED
+    uint64_t load_size;         // bytes of PT_LOAD segments in memory
+
+    LoadCost()
+    {
+        measured = false;
+        relative = symbolic = plt = lookups = load_size = 0;
+        bind_now = prelinked = false;
+    };
+
+    // a single figure to rank objects by: a lookup walks hash chains and
+    // compares strings, where a relative relocation is a single store
+    uint64_t weight(void) const
+    {
+        return 8 * lookups + relative + plt;
+    };
+
+    void add(const LoadCost & c)
+    {
+        measured = measured || c.measured;
+        relative += c.relative;
+        symbolic += c.symbolic;
+        plt += c.plt;
+        lookups += c.lookups;
+        load_size += c.load_size;
+    };
+};
+
+// StartupProfile is what ld.so reports of its work, in CPU cycles, over
+// one or more runs of an executable
+struct StartupProfile
+{
+    unsigned int runs;
+    uint64_t startup_min, startup_sum;  // total time in the loader
+    uint64_t relocation_min, relocation_sum;
+    uint64_t load_min, load_sum;        // time mapping objects
+    uint64_t relocations;       // symbolic, and relative, of the last run
+    uint64_t relative;
+
+    StartupProfile()
+    {
+        runs = 0;
+        startup_min = startup_sum = relocation_min = relocation_sum = 0;
+        load_min = load_sum = relocations = relative = 0;
+    };
+
+    void add(uint64_t startup, uint64_t relocation, uint64_t load)
+    {
+        startup_min = runs == 0 ? startup : std::min(startup_min, startup);
+        relocation_min = runs == 0 ? relocation :
+            std::min(relocation_min, relocation);
+        load_min = runs == 0 ? load : std::min(load_min, load);
+        startup_sum += startup;
+        relocation_sum += relocation;
+        load_sum += load;
+        runs++;
+    };
+};
+
+// Node represents a dynamically loadable executalbe or shared object
+class Node
+{
+ private:
+    unsigned int path;          // interned
+    bool labeled_in;            // some labeled edge points to this node
+    LoadCost cost;
+    int load_order;             // place in measured load order, or -1
+    StartupProfile profile;     // measured startup, for a root
+    bool has_dominance;         // dominators were computed
+    Node *idom;                 // immediate dominator, or NULL for a root
+    unsigned int dominated;     // nodes it dominates
+    uint64_t dominated_weight;  // their load cost weights, and its own
+
+ public:
+    Node(const std::string & p)
+    {
+        path = intern_string(p);
+        labeled_in = false;
+        load_order = -1;
+        has_dominance = false;
+        idom = NULL;
+        dominated = 0;
+        dominated_weight = 0;
+    };
+
+    void setPath(const std::string & s)
+    {
+        path = intern_string(s);
+    };
+
+    const std::string & getPath(void)
+    {
+        return interned_string(path);
+    };
+
+    unsigned int getPathId(void)
+    {
+        return path;
+    };
+
+    void setLabeledIn(bool l)
+    {
+        labeled_in = l;
+    };
+
+    bool isLabeledIn(void)
+    {
+        return labeled_in;
+    };
+
+    void setCost(const LoadCost & c)
+    {
+        cost = c;
+    };
+
+    const LoadCost & getCost(void)
+    {
+        return cost;
+    };
+
+    void setLoadOrder(int o)
+    {
+        load_order = o;
+    };
+
+    int getLoadOrder(void)
+    {
+        return load_order;
+    };
+
+    void setProfile(const StartupProfile & p)
+    {
+        profile = p;
+    };
+
+    const StartupProfile & getProfile(void)
+    {
+        return profile;
+    };
+
+    // the node every path from the roots to this one passes through last,
+    // and what would no longer be loaded without this one
+    void setDominance(Node * d, unsigned int count, uint64_t weight)
+    {
+        has_dominance = true;
+        idom = d;
+        dominated = count;
+        dominated_weight = weight;
+    };
+
+    bool hasDominance(void)
+    {
+        return has_dominance;
+    };
+
+    Node *getDominator(void)
+    {
+        return idom;
+    };
+
+    unsigned int getDominated(void)
+    {
+        return dominated;
+    };
+
+    uint64_t getDominatedWeight(void)
+    {
+        return dominated_weight;
+    };
+
+    std::string getPathQuoted(void)
+    {
+        std::string s;
+
+        appendPathQuoted(s);
+
+        return s;
+    };
+
+    // append the node's path quoted as a DOT id, without building a
+    // string for it
+    void appendPathQuoted(std::string & buf)
+    {
+        buf += '"';
+        buf += getPath();
+        buf += '"';
+    };
+};
+
+// Nodes owns the nodes of a graph in an arena, and lists them in output
+// order. A node can be created ahead of being listed.
+class Nodes
+{
+ private:
+    Arena < Node > *arena;
+    std::vector < Node * >list;
+
+    Nodes(const Nodes &);
+    Nodes & operator =(const Nodes &);
+
+ public:
+    typedef std::vector < Node * >::iterator iterator;
+
+    Nodes();
+    ~Nodes();
+
+    Node *create(const std::string & path);
+
+    void push_back(Node * node)
+    {
+        list.push_back(node);
+    };
+
+    Node *add(const std::string & path)
+    {
+        Node *node = create(path);
+
+        list.push_back(node);
+
+        return node;
+    };
+
+    iterator begin(void)
+    {
+        return list.begin();
+    };
+
+    iterator end(void)
+    {
+        return list.end();
+    };
+
+    size_t size(void)
+    {
+        return list.size();
+    };
+
+    Node *operator[] (size_t i)
+    {
+        return list[i];
+    };
+
+    // list nodes of the graph in place of those listed
+    void assign(const std::vector < Node * >&l)
+    {
+        list = l;
+    };
+
+    // free every node of the graph
+    void clear(void);
+
+    // exchange graphs, passing ownership of the nodes
+    void swap(Nodes & n)
+    {
+        std::swap(arena, n.arena);
+        list.swap(n.list);
+    };
+};
+
+/*************************
+ *  Edge
+ *************************/
+
+// edge represents a single requirement between nodes and is labeled
+// with the symbol version. If it is a versioned requirement it is
+// marked as 'strong'. The non-strong requirements are marked with a
+// dotted line and the strong ones with a solid line.
+
+class Edge
+{
+ private:
+    Node * from;
+    Node *to;
+    std::vector < unsigned int > labels;        // interned
+    bool has_symbols;           // symbols bound across it were counted
+    int load_order;             // load order of the object it loaded, or 0
+    unsigned int symbol_count;
+    std::vector < unsigned int > symbols;       // interned names, if kept
+
+ public:
+    std::string getLabels(const std::string & delimiter)
+    {
+        std::string out;
+
+        appendLabels(out, delimiter.c_str());
+
+        return out;
+    };
+
+    void appendLabels(std::string & buf, const char *delimiter)
+    {
+        for (std::vector < unsigned int >::iterator ln = labels.begin();
+            ln != labels.end(); ++ln)
+        {
+            if (ln != labels.begin())
+            {
+                buf += delimiter;
+            }
+
+            buf += interned_string(*ln);
+        }
+    };
+
+    Edge(Node * f, Node * t)
+    {
+        from = f;
+        to = t;
+        has_symbols = false;
+        symbol_count = 0;
+        load_order = 0;
+    };
+
+    void addLabel(const std::string & l)
+    {
+        labels.push_back(intern_string(l));
+    };
+
+    const std::vector < unsigned int > &getLabelIds(void)
+    {
+        return labels;
+    };
+
+    // add the labels of another edge which this edge lacks
+    void mergeLabels(Edge * e)
+    {
+        for (std::vector < unsigned int >::iterator ln = e->labels.begin();
+            ln != e->labels.end(); ++ln)
+        {
+            if (std::find(labels.begin(), labels.end(), *ln) == labels.end())
+            {
+                labels.push_back(*ln);
+            }
+        }
+    };
+
+    // take on the labels, bound symbols and load order of an edge this
+    // one replaces
+    void merge(Edge * e)
+    {
+        mergeLabels(e);
+
+        if (e->has_symbols)
+        {
+            has_symbols = true;
+            symbol_count += e->symbol_count;
+            symbols.insert(symbols.end(), e->symbols.begin(),
+                e->symbols.end());
+        }
+
+        if (load_order == 0)
+        {
+            load_order = e->load_order;
+        }
+    };
+
+    Node *getFrom(void)
+    {
+        return from;
+    };
+
+    Node *getTo(void)
+    {
+        return to;
+    };
+
+    bool isLabeled(void)
+    {
+        return !labels.empty();
+    };
+
+    // record the symbols the from node binds to in the to node
+    void setSymbols(unsigned int count, const std::vector < unsigned int >&s)
+    {
+        has_symbols = true;
+        symbol_count = count;
+        symbols = s;
+    };
+
+    bool hasSymbols(void)
+    {
+        return has_symbols;
+    };
+
+    unsigned int getSymbolCount(void)
+    {
+        return symbol_count;
+    };
+
+    const std::vector < unsigned int >&getSymbolIds(void)
+    {
+        return symbols;
+    };
+
+    // the edge was the one found first by ld.so for the object it loaded
+    void setLoadOrder(int o)
+    {
+        load_order = o;
+    };
+
+    int getLoadOrder(void)
+    {
+        return load_order;
+    };
+
+    // a needed object none of whose symbols are used
+    bool isUnused(void)
+    {
+        return has_symbols && symbol_count == 0;
+    };
+};
+
+// Edges owns the edges of a graph in an arena, and lists them in output
+// order. Edges erased from the list are freed along with the others.
+class Edges
+{
+ private:
+    Arena < Edge > *arena;
+    std::vector < Edge * >list;
+
+    Edges(const Edges &);
+    Edges & operator =(const Edges &);
+
+ public:
+    typedef std::vector < Edge * >::iterator iterator;
+
+    Edges();
+    ~Edges();
+
+    Edge *add(Node * from, Node * to);
+
+    iterator begin(void)
+    {
+        return list.begin();
+    };
+
+    iterator end(void)
+    {
+        return list.end();
+    };
+
+    size_t size(void)
+    {
+        return list.size();
+    };
+
+    Edge *operator[] (size_t i)
+    {
+        return list[i];
+    };
+
+    // list edges of the graph in place of those listed
+    void assign(const std::vector < Edge * >&l)
+    {
+        list = l;
+    };
+
+    void erase(iterator first, iterator last)
+    {
+        list.erase(first, last);
+    };
+
+    // free every edge of the graph
+    void clear(void);
+
+    // exchange graphs, passing ownership of the edges
+    void swap(Edges & e)
+    {
+        std::swap(arena, e.arena);
+        list.swap(e.list);
+    };
+};
+
+/*************************
+ *  Graph sinks
+ *************************/
+
+// GraphSink receives the graph of each document read from an input, in
+// input order
+class GraphSink
+{
+ public:
+    virtual ~ GraphSink()
+    {
+    };
+
+    virtual void add(std::string & path, Nodes & nodes, Edges & edges) = 0;
+};
+
+// the graph of one document, kept for later
+struct Document
+{
+    std::string path;
+    Nodes nodes;
+    Edges edges;
+};
+
+}                               // namespace lddgraph
+
+#endif
@@ -12,8 +12,15 @@
  *   argument, or the output of running ldd -v in a file argument or stdin (with
  *   - argument), and emit a graphviz directed graph DOT file on stdout.
  *
+ *   Executables and shared objects are read directly: the dynamic section of
+ *   each object is examined and its DT_NEEDED entries are located following
+ *   the ld.so search rules (DT_RPATH, LD_LIBRARY_PATH, DT_RUNPATH,
+ *   /etc/ld.so.cache, or the ld.so.conf directories if there is no cache, and
+ *   the default directories). With -l they are run through ldd -v instead.
+ *
  *   The output DOT file may be passed to the 'dot' command to plot it into a
- *   displayable format (e.g. png).
+ *   displayable format (e.g. png). Its nodes have short ids, n0, n1 and so
+ *   on in output order, and are labeled with their paths.
  *
  *   ld.so (the Linux ELF loader) will load and relocate every node of the output
  *   graph -- all the objects listed at the top of the ldd -v output.
@@ -25,12 +32,183 @@
  *
  * OPTIONS
  *   -    read ldd -v output on stdin
+ *   -c, --cost
+ *        measure the load cost of each object read directly: relocations
+ *        needing no symbol, needing a symbol and in the PLT, symbol lookups
+ *        at startup, BIND_NOW, prelinking and the size of its PT_LOAD
+ *        segments; the info block gives the totals, and nodes are shaded
+ *        red by their share of the costliest object's relocation work
+ *   -k, --collapse-cycles
+ *        replace each cycle of objects needing each other with one node
+ *        named for its members, joining the edges into and out of it
+ *   -K, --keep-going
+ *        carry on past an input that cannot be graphed, such as a missing
+ *        file, one that is not dynamically loaded or an ldd -v that failed,
+ *        keeping the graphs of the others: each failure is reported in
+ *        input order as the graphs are written, then all of them once more
+ *        with their number at the end, and the exit status is 1. Without
+ *        -K the first failure ends the run, after the graphs of the inputs
+ *        before it
+ *   -l, --ldd
+ *        run executables and shared objects through ldd -v rather than
+ *        reading them directly
+ *   -m, --multiple
+ *        ldd -v text inputs may hold many documents back to back, such as
+ *        concatenated dumps or the output of ldd -v given many files; each
+ *        document is graphed on its own as soon as it has been read
+ *   -p N, --profile=N
+ *        run each executable N times under LD_DEBUG=statistics,files, with
+ *        no arguments and stdin and stdout on /dev/null, and add the
+ *        fastest and mean startup, relocation and load times ld.so reports
+ *        to the info block; nodes are marked with the order they were
+ *        loaded in, and edges with the load they caused. Each run has a
+ *        process group of its own, and a run killed by a signal, or still
+ *        running at the --timeout, fails its input
+ *   -s, --symbols
+ *        bind the undefined dynamic symbols of each object to the first
+ *        object in load order defining them, using their DT_GNU_HASH or
+ *        DT_HASH tables, and label each DT_NEEDED edge with the number of
+ *        symbols bound across it; needed objects providing no symbols have
+ *        their edges drawn in red (executables and shared objects read
+ *        directly only)
+ *   -S, --symbol-names
+ *        as -s, also listing the names of the symbols bound across each edge
+ *   -t, --reduce
+ *        drop each edge from one object to another that is also reached
+ *        through a longer path, such as the edge from an executable to
+ *        libc when a library it needs also needs libc, along with the
+ *        edge's labels; edges within cycles are kept
+ *   -u, --union
+ *        emit one graph merging all input files, with one node per canonical
+ *        path and the labels of each edge combined; an edge's bound symbols
+ *        and an object's load order are those of the first input file with
+ *        them. The info block lists the node and edge counts of each input
+ *        file
+ *   -x, --dominators
+ *        find for each object the last object every path to it passes
+ *        through, the one it is loaded only because of, and label nodes
+ *        "only via" that object and with how many objects they alone
+ *        bring in (and, with -c, their share of the load cost); edges of
+ *        the dominator tree are drawn thick. The passes run after the
+ *        graph is read, or merged with -u, in the order -k, -x, -t
+ *   -j N, --jobs=N
+ *        process N input files at a time, 0 for one per processor; the
+ *        graphs are still emitted in input order. Threads left over when there
+ *        are fewer input files than N read the objects each file needs ahead
+ *        of its search
+ *   -f LIST, --files-from=LIST
+ *        also read input file paths, one per line, from LIST (- for stdin)
+ *   -C FILE, --cache=FILE
+ *        keep the dynamic linking information read from each object in
+ *        FILE (e.g. ~/.cache/lddgraph.db) across runs; an object is read
+ *        again when its device, inode, size or modification time change,
+ *        and only its latest read is kept
+ *   -d SOCKET, --daemon=SOCKET
+ *        serve graphs on the Unix socket SOCKET instead of reading files:
+ *        each connection sends one root path on a line and receives its
+ *        DOT graph; replies and object reads are kept in memory and
+ *        replies are dropped when a directory holding their objects changes
+ *   -o FORMAT, --format=FORMAT
+ *        write graphs as FORMAT: dot (the default); json, one object per
+ *        line per graph listing its file, nodes and edges, each edge with its
+ *        from and to paths, strong flag and labels; tsv, one line per edge
+ *        holding the file, from, to, strong or weak, and the labels separated
+ *        by commas; or binary, a compact record per graph holding a string
+ *        table, the edges grouped by source node and their label strings.
+ *        Binary graph files may be given as input files, and are read back
+ *        without parsing
+ *   -D FILE, --diff=FILE
+ *        report only what changed in the graph of each input since FILE,
+ *        a binary graph file written by an earlier run with -o binary
+ *        (or ldd -v output): the nodes and edges added and removed, and
+ *        the version labels added to and removed from the edges in both;
+ *        unchanged graphs are not written. In DOT, additions are green,
+ *        removals dashed red and relabeled edges blue; json and tsv list
+ *        the changes by kind. With -C only the objects which changed since
+ *        they were cached are read again
+ *   -I FILE, --index=FILE
+ *        with input files, write to FILE a reverse dependency index of
+ *        their graphs instead of the graphs themselves (with -u the union
+ *        graph is written too): for each object, by path and by file name,
+ *        and each version label, the objects needing it directly and the
+ *        input files loading it
+ *   -q NAME, --query=NAME
+ *        with -I and no input files, look NAME up in the index and list
+ *        the objects needing it directly and the input files loading it,
+ *        one per line after NAME and "direct" or "root", or with -o json
+ *        as a line per query; the exit status is 1 if a NAME is not
+ *        indexed. -q may be given many times
+ *   -L N, --max-depth=N
+ *        follow needed objects only N levels down from each input file;
+ *        the objects at depth N are graphed but their own needs are not,
+ *        and 0 graphs the input file alone
+ *   -i GLOB, --include=GLOB
+ *        follow only needed objects whose path or file name matches GLOB
+ *        (see fnmatch(3)); may be given many times
+ *   -e GLOB, --exclude=GLOB
+ *        leave out needed objects whose path or file name matches GLOB,
+ *        with the objects only they bring in; may be given many times
+ *   -F GLOB, --fold=GLOB
+ *        draw the needed objects matching GLOB as one node named GLOB,
+ *        with the edges into them joined and their own needs left out,
+ *        such as -F 'libc.so*' -F 'ld-linux*' to hide glibc; may be given
+ *        many times. -e is applied before -F and -F before -i. Objects
+ *        read directly are filtered while they are searched for, so
+ *        objects left out or folded, and those below depth N, are never
+ *        opened; ldd -v output is filtered line by line as it is parsed
+ *        and the depth is cut once a document has been read
+ *   -a FILE, --archive=FILE
+ *        read a file system image from FILE, a tar archive such as an OCI
+ *        image layer (- for stdin; gzip, zstd and xz files are
+ *        decompressed), in a single pass with nothing written to disk: the
+ *        dynamic sections of its ELF members, its links and its ld.so
+ *        configuration are kept in memory and the other members are
+ *        skipped. The input files are then paths in the image, and
+ *        without any every dynamically linked executable in it is graphed.
+ *        -a may be given once per layer, lowest first, later layers
+ *        replacing files and deleting them with their whiteouts. Not with
+ *        --sysroot, -l, -p, -s, -S, -c or -d
+ *   --sysroot=DIR
+ *        read directly the executables and shared objects of another
+ *        system's image, such as an unpacked root file system or container
+ *        layer, of any architecture and byte order: needed objects, the
+ *        interpreter, /etc/ld.so.cache and /etc/ld.so.conf are looked up
+ *        inside DIR, with symbolic links resolved inside it, and nodes are
+ *        named by their paths in the image. Input files under DIR are
+ *        named the same way; others are read as given and searched from
+ *        as if they were installed in the image. LD_LIBRARY_PATH is
+ *        ignored, and -l and -p, which run the image's own loader, are
+ *        refused
+ *   --ldd-jobs=N
+ *        with -l, run ldd -v on at most N input files at once (by
+ *        default as many as -j gives), ahead of their parse; each runs
+ *        without a shell, and one thread reads the output of them all
+ *   --timeout=SECONDS
+ *        with -l, kill an ldd -v still running SECONDS after it started,
+ *        and its loader with it, failing that input rather than stalling
+ *        the batch; with -p, profiled runs are killed the same way
+ *   --stats[=json]
+ *        report to stderr, for each input and in total, the time spent
+ *        opening (or running ldd, and waiting for it), parsing, closing,
+ *        trimming and emitting, the lines parsed, documents, nodes, edges
+ *        and candidate files looked up, and whether it failed and why,
+ *        then the wall time, the CPU time of lddgraph and of its ldd
+ *        children, and their peak RSS; with =json as a single JSON object
  *   -?   provide help message
  *
  * EXAMPLES
  *   lddgraph /bin/bash | dot -Tpng > g.png && eog g.png
  *   lddgraph /usr/lib/libgdal.so | dot -Tpng > g.png; eog g.png
  *   ldd -v /bin/uname | lddgraph - | dot -Tpng > g.png; eog g.png
+ *   lddgraph -o binary -f list > bin.ldg; lddgraph -u bin.ldg > union.dot
+ *   lddgraph -C ~/.cache/lddgraph.db -D bin.ldg -f list > changes.dot
+ *   lddgraph -j 0 -I deps.idx -f list; lddgraph -I deps.idx -q libssl.so.3
+ *   lddgraph -L 2 -e 'libstdc++*' -F 'libc.so*' /bin/ls > shallow.dot
+ *   lddgraph --sysroot=rootfs -u -f rootfs.list > image.dot
+ *   lddgraph -a layer.tar.gz -u -o json > image.json
+ *   lddgraph -K -l --timeout=10 -f list > graphs.dot 2> failures.txt
+ *   lddgraph -d /tmp/lddgraph.sock &
+ *   echo /bin/ls | socat - UNIX-CONNECT:/tmp/lddgraph.sock
  *
  * BUGS
  *   Same issues as ldd has.
@@ -39,7 +217,12 @@
  *   ld.so(8), ldconfig(8), ldd(8), dot(1), graphviz(7)
  *
  * COMPILE WITH
- *   c++ -std=c++98 -o lddgraph lddgraph.cpp
+ *   c++ -std=c++98 -pthread -o lddgraph main.cpp lddgraph.cpp
+ *
+ * LIBRARY
+ *   Everything but main.cpp is liblddgraph.a, with graph.h, emit.h and
+ *   lddgraph.h, for reading graphs into a GraphSink in process; see
+ *   lddgraph.h and README.md.
  *
  * AUTHOR
  *   James Perkins, April 2021
@@ -68,17 +251,45 @@
  */
 
 // C++ APIs
+#include <algorithm>            // std::find
+#include <fstream>              // std::ifstream
 #include <iostream>             // std::cin, cout, cerr, endl
 #include <sstream>              // std::istringstream
 #include <vector>               // std::vector
+#include <map>                  // std::map
+#include <set>                  // std::set
 
 // C APIs
+#include <ctype.h>              // isspace
 #include <errno.h>              // errno
+#include <fcntl.h>              // open, O_RDONLY
+#include <fnmatch.h>            // fnmatch
+#include <getopt.h>             // getopt_long
+#include <glob.h>               // glob, globfree
+#include <limits.h>             // PATH_MAX
+#include <poll.h>               // poll
+#include <pthread.h>            // pthread_create, mutexes, conditions
+#include <signal.h>             // signal, kill, SIGPIPE, SIGINT, SIGTERM
+#include <spawn.h>              // posix_spawn(p), file actions, attributes
+#include <stddef.h>             // offsetof
+#include <stdint.h>             // uint64_t
 #include <stdio.h>              // popen, pclose, FILE, BUFSIZ
-#include <stdlib.h>             // exit, EXIT_SUCCESS, EXIT_FAILURE
+#include <stdlib.h>             // exit, EXIT_SUCCESS, EXIT_FAILURE, realpath
 #include <string.h>             // strerror
-#include <unistd.h>             // access, X_OK
+#include <time.h>               // clock_gettime
+#include <unistd.h>             // access, X_OK, close, readlink
 #include <elf.h>                // ELF constants and offsets
+#include <sys/inotify.h>        // inotify_init1, inotify_add_watch
+#include <sys/mman.h>           // mmap, munmap, madvise
+#include <sys/socket.h>         // socket, bind, listen, accept
+#include <sys/resource.h>       // getrusage
+#include <sys/stat.h>           // fstat, lstat, S_ISREG, S_ISLNK
+#include <sys/un.h>             // sockaddr_un
+#include <sys/wait.h>           // waitpid, WIFEXITED, WEXITSTATUS
+
+#include "lddgraph.h"
+
+extern char **environ;
 
 // uncomment for a lot of output to stderr
 //#define DEBUG
@@ -89,665 +300,9172 @@
 #define DEBUG_OUT(x)
 #endif
 
+// everything is in the library's namespace, the internals too, so that
+// none of it collides with the names of a program linking it
+namespace lddgraph
+{
+
 /*************************
  *  string helpers       
  *************************/
 
 // remove string from front of string
-static std::string trim_front(const std::string s, const std::string x)
+static std::string trim_front(const std::string & s, const std::string & x)
 {
     size_t n = x.size();
-    return (s.substr(0, n) == x) ? s.substr(n) : s;
+    return s.compare(0, n, x) == 0 ? s.substr(n) : s;
 }
 
 // detect string at end of string
-static bool ends_with(const std::string s, const std::string x)
+static bool ends_with(const std::string & s, const std::string & x)
 {
     size_t n = s.size();
     size_t m = x.size();
-    return n >= m && s.substr(n - m, m) == x;
+    return n >= m && s.compare(n - m, m, x) == 0;
 }
 
 // remove string from end of string
-static std::string trim_end(const std::string s, const std::string x)
+static std::string trim_end(const std::string & s, const std::string & x)
 {
     return ends_with(s, x) ? s.substr(0, s.size() - x.size()) : s;
 }
 
-// detect "(" at start and ")" at end of string
-static bool has_outer_parens(const std::string s)
-{
-    return ends_with(s, ")") && s[0] == '(';
-}
-
-// remove "(" from start and ")" from end of string
-static std::string trim_outer_parens(std::string s)
-{
-    return has_outer_parens(s) ? s.substr(1, s.size() - 2) : s;
-}
-
 /*************************
- *  Node
+ *  String views
  *************************/
 
-// Node represents a dynamically loadable executalbe or shared object
-class Node
+// StringRef is a view of characters owned by someone else, such as a
+// line in a LineReader buffer
+class StringRef
 {
  private:
-    std::string path;
+    const char *data;
+    size_t len;
 
  public:
-    void dump(void)
+    StringRef()
     {
-        DEBUG_OUT(std::cerr << "node: path " << path << std::endl);
+        data = "";
+        len = 0;
     };
 
-    Node(std::string p)
+    StringRef(const char *d, size_t n)
     {
-        path = p;
-        this->dump();
+        data = d;
+        len = n;
     };
 
-    void setPath(std::string s)
+    size_t size(void) const
     {
-        path = s;
+        return len;
     };
 
-    std::string getPath(void)
+    char operator[] (size_t i) const
     {
-        return path;
+        return data[i];
     };
 
-    std::string getPathQuoted(void)
+    const char *chars(void) const
     {
-        std::string s("\"");
-        s += path;
-        s += "\"";
-
-        return s;
+        return data;
     };
-};
-
-typedef std::vector < Node * >Nodes;
-
-/*************************
- *  Edge
- *************************/
 
-// edge represents a single requirement between nodes and is labeled
-// with the symbol version. If it is a versioned requirement it is
-// marked as 'strong'. The non-strong requirements are marked with a
-// dotted line and the strong ones with a solid line.
-
-class Edge
-{
- private:
-    Node * from;
-    Node *to;
-    std::vector < std::string > labels;
-
- public:
-    std::string getLabels(std::string delimiter)
+    StringRef substr(size_t pos, size_t n = std::string::npos) const
     {
-        std::string out;
-
-        for (std::vector < std::string >::iterator ln = labels.begin();
-            ln != labels.end(); ++ln)
+        if (pos > len)
         {
-            if (ln != labels.begin())
-            {
-                out += delimiter;
-            }
-
-            out += *ln;
+            pos = len;
         }
 
-        return out;
-    };
-
-    void dump(void)
-    {
-        DEBUG_OUT(std::cerr << "edge: from " << from->getPath() <<
-            " to " << to->getPath() << " labels " <<
-            getLabels(" ") << std::endl);
-    };
-
-    Edge(Node * f, Node * t)
-    {
-        from = f;
-        to = t;
-        this->dump();
-    };
-
-    void addLabel(std::string l)
-    {
-        labels.push_back(l);
+        return StringRef(data + pos, n < len - pos ? n : len - pos);
     };
 
-    Node *getFrom(void)
+    bool operator ==(const char *s) const
     {
-        return from;
+        return strncmp(data, s, len) == 0 && s[len] == '\0';
     };
 
-    Node *getTo(void)
+    bool operator !=(const char *s) const
     {
-        return to;
+        return !(*this == s);
     };
 
-    bool isLabeled(void)
+    std::string str(void) const
     {
-        return getLabels(" ") != "";
+        return std::string(data, len);
     };
 };
 
-typedef std::vector < Edge * >Edges;
-
-/*************************
- *  File helpers
- *************************/
-
-// detect dynamically loaded Embedded Linker Format (ELF) file
-static bool is_ELF_file(std::string path)
+static std::ostream & operator <<(std::ostream & out, const StringRef & s)
 {
-    // Open the file to determine if it is ELF
-    FILE *fp = fopen(path.c_str(), "rb");
-
-    if (fp == NULL)
-    {
-        std::cerr << path << ": fopen failed: " << strerror(errno) << std::endl;
-        exit(EXIT_FAILURE);
-    }
+    return out.write(s.chars(), s.size());
+}
 
-    // the ELF Identification header is 16 bytes and is followed by
-    // the type field (which indicates if it is a dynamic load object).
-    unsigned char s[EI_NIDENT + sizeof(Elf64_Half)];
+// the string helpers, on views
+static StringRef trim_front(const StringRef & s, const char *x)
+{
+    size_t n = strlen(x);
+    return s.substr(0, n) == x ? s.substr(n) : s;
+}
 
-    size_t n = fread(s, 1, sizeof(s), fp);
+static bool ends_with(const StringRef & s, const char *x)
+{
+    size_t n = s.size();
+    size_t m = strlen(x);
+    return n >= m && s.substr(n - m) == x;
+}
 
-    if (n == 0)
-    {
-        std::cerr << path << ": fread failed: " << strerror(errno) << std::endl;
-        fclose(fp);
-        exit(EXIT_FAILURE);
-    }
+static StringRef trim_end(const StringRef & s, const char *x)
+{
+    return ends_with(s, x) ? s.substr(0, s.size() - strlen(x)) : s;
+}
 
-    fclose(fp);
+// detect "(" at start and ")" at end of string
+static bool has_outer_parens(const StringRef & s)
+{
+    return ends_with(s, ")") && s.size() > 0 && s[0] == '(';
+}
 
-    // a short file is not ELF
-    if (n < sizeof(s))
-    {
-        DEBUG_OUT(std::cerr << path << ": short read" << std::endl);
+// remove "(" from start and ")" from end of string
+static StringRef trim_outer_parens(const StringRef & s)
+{
+    return has_outer_parens(s) ? s.substr(1, s.size() - 2) : s;
+}
 
-        return false;
-    }
+// split a line into whitespace separated fields, reusing f's storage
+static void split_fields(const StringRef & line, std::vector < StringRef > &f)
+{
+    f.clear();
 
-    // a file with the wrong MAGIC or field values is not ELF
-    if (s[EI_MAG0] != ELFMAG0 || s[EI_MAG1] != ELFMAG1 ||
-        s[EI_MAG2] != ELFMAG2 || s[EI_MAG3] != ELFMAG3 ||
-        !(s[EI_CLASS] == ELFCLASS32 || s[EI_CLASS] == ELFCLASS64) ||
-        !(s[EI_DATA] == ELFDATA2LSB || s[EI_DATA] == ELFDATA2MSB) ||
-        s[EI_VERSION] != EV_CURRENT ||
-        !((s[EI_DATA] == ELFDATA2LSB && s[EI_NIDENT] == ET_DYN &&
-                s[EI_NIDENT + 1] == 0) ||
-            (s[EI_DATA] == ELFDATA2MSB && s[EI_NIDENT] == 0 &&
-                s[EI_NIDENT + 1] == ET_DYN)))
+    for (size_t i = 0; i < line.size();)
     {
-        DEBUG_OUT(std::cerr << path <<
-            ": not recognized as an ELF dynamic load input file" << std::endl);
-        return false;
-    }
+        while (i < line.size() && isspace((unsigned char)line[i]))
+        {
+            i++;
+        }
 
-#if DEBUG
-    // describe the file for debug folks
-    unsigned int width = s[EI_CLASS] == ELFCLASS32 ? 32 :
-        s[EI_CLASS] == ELFCLASS64 ? 64 : 0;
+        size_t start = i;
 
-    std::cerr << path << ": " << width << " bits, dynamic load file"
-        << std::endl;
-#endif
+        while (i < line.size() && !isspace((unsigned char)line[i]))
+        {
+            i++;
+        }
 
-    return true;
+        if (i > start)
+        {
+            f.push_back(line.substr(start, i - start));
+        }
+    }
 }
 
 /*************************
- *  Parser
+ *  Line reader
  *************************/
 
-class Parser
+// LineReader splits a stream into lines of any length, handed out as
+// views into one large buffer which is refilled as lines are consumed.
+// A view is valid until the next line is read. A regular file may be
+// mapped instead, and its lines are then views of the mapping.
+class LineReader
 {
  private:
-    std::string path;           // file pathname
-    FILE *fp;                   // open file pointer
-    bool is_pipe;               // opened with popen
-    bool real_path_pending;     // ldd needs to tell us the pathname
-    Node *cur_node;             // node to be used as from in edges
-    bool got_version_info;      // false until we see Version info:
-    Node *not_found_node;       // virtual node for unfound objects
+    FILE *fp;
+    const char *map;            // mapped file contents, or NULL
+    size_t map_size;
+    bool mapped;                // map is a mapping to undo
+    std::vector < char > buf;
+    size_t start;               // first unconsumed byte
+    size_t line_start;          // first byte of the last line handed out
+    size_t scanned;             // bytes from start known to hold no newline
+    size_t end;                 // end of data in buf
+    bool at_eof;
+    bool failed;
 
-    Node *find_existing_node(Nodes & nodes, std::string & path)
+ public:
+    LineReader()
     {
-        for (Nodes::iterator pn = nodes.begin(); pn != nodes.end(); ++pn)
-        {
-            if ((*pn)->getPath() == path)
-            {
-                return *pn;
-            }
-        }
-
-        std::cerr << path << ": cannot find prior reference!" << std::endl;
-        exit(EXIT_FAILURE);
+        fp = NULL;
+        map = NULL;
+        map_size = 0;
+        mapped = false;
+        start = line_start = scanned = end = 0;
+        at_eof = false;
+        failed = false;
     };
 
-    Edge *find_edge_from_to(Edges & edges, Node * from, Node * to)
+    ~LineReader()
     {
-        for (Edges::iterator pe = edges.begin(); pe != edges.end(); ++pe)
+        if (mapped)
         {
-            if ((*pe)->getFrom() == from && (*pe)->getTo() == to)
-            {
-                return *pe;
-            }
+            munmap((void *)map, map_size);
         }
+    };
 
-        return NULL;
-    }
+    void attach(FILE * f)
+    {
+        fp = f;
+        buf.resize(1 << 16);
+    };
 
-    bool process_line(Nodes & nodes, Edges & edges)
+    // read a regular file through a mapping rather than through f,
+    // false if it can't be mapped
+    bool attachMapped(FILE * f)
     {
-        char line[BUFSIZ];
+        struct stat st;
 
-        // use janky old stdout fgets to grab a line
-        if (fgets(line, sizeof(line), fp) == NULL)
+        if (fstat(fileno(f), &st) != 0 || !S_ISREG(st.st_mode) ||
+            st.st_size == 0)
         {
             return false;
         }
 
-        // convert into vector of strings, f
-        std::vector < std::string > f;
+        void *m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
 
+        if (m == MAP_FAILED)
         {
-            std::string line_s = std::string(line);
-            std::istringstream line_is(line_s);
-            std::string fi;
-
-            while (line_is >> fi)
-            {
-                f.push_back(fi);
-            }
+            return false;
         }
 
-        // input:
-        if (f.size() == 0)
-        {
-            return true;
-        }
+        madvise(m, st.st_size, MADV_SEQUENTIAL);
+        fp = f;
+        map = (const char *)m;
+        map_size = st.st_size;
+        mapped = true;
+        end = map_size;
+        at_eof = true;
 
-        // input: not a <...>
-        if (f.size() == 4 && f[0] == "not" && f[1] == "a")
-        {
-            std::cerr << path << ": not a dynamically loaded file" << std::endl;
-            exit(EXIT_FAILURE);
-        }
+        return true;
+    };
 
-        // input: <path>: <libpath>: version `<symbol>' not found (required by <path>)
-        if (f.size() == 5 && ends_with(f[0], ":") && ends_with(f[1], ":") &&
-            f[2] == "version" && f[4] == "not")
-        {
-            std::cerr <<
-                "some symbol versions are unresolvable, input: " << line;
-            return true;
-        }
+    // read input already in memory, which must outlive the reader
+    void attachBuffer(const std::string & data)
+    {
+        map = data.data();
+        map_size = data.size();
+        end = map_size;
+        at_eof = true;
+    };
 
-        // input: Version information:
-        if (f.size() == 2 && f[0] == "Version" && f[1] == "information:")
+    // false at end of input
+    bool next(StringRef & line)
+    {
+        if (map != NULL)
         {
-            got_version_info = true;
+            if (start >= end)
+            {
+                return false;
+            }
+
+            const char *p = map + start;
+            const char *nl = (const char *)memchr(p, '\n', end - start);
+            size_t n = nl != NULL ? nl - p : end - start;
+
+            line = StringRef(p, n);
+            line_start = start;
+            start += n + 1;
             return true;
         }
 
-        // input: <lib> (<loadaddr>)
-        // input: <lib> =>  (<loadaddr>)
-        // input: <lib> => <path> (<loadaddr>)
-        // input: <lib> => not found
-        if (got_version_info == false && (f.size() == 2 || f.size() == 3 ||
-                f.size() == 4))
+        for (;;)
         {
-            std::string field(f.size() == 4 ? f[2] : f[0]);
+            const char *p = &buf[start];
+            const char *nl = (const char *)memchr(p + scanned, '\n',
+                end - start - scanned);
 
-            // input: <lib> => not found
-            bool not_found = f.size() == 4 && f[2] == "not" && f[3] == "found";
-
-            if (not_found)
+            if (nl != NULL)
             {
-                std::cerr << f[0] << ": shared object not found, input: " <<
-                    line;
-                field = f[0];
+                line = StringRef(p, nl - p);
+                line_start = start;
+                start += nl - p + 1;
+                scanned = 0;
+                return true;
             }
 
-            Node *sub_node = new Node(trim_front(field, "./"));
-            nodes.push_back(sub_node);
+            // an unterminated last line
+            if (at_eof)
+            {
+                line = StringRef(p, end - start);
+                line_start = start;
+                start = end;
+                scanned = 0;
+                return line.size() > 0;
+            }
 
-            Edge *edge = new Edge(cur_node, sub_node);
-            edges.push_back(edge);
+            // keep the partial line, growing the buffer if it fills it
+            scanned = end - start;
+            memmove(&buf[0], p, scanned);
+            start = 0;
+            end = scanned;
 
-            // TODO test
-            if (not_found)
+            if (end == buf.size())
             {
-                if (not_found_node == NULL)
-                {
-                    not_found_node = new Node("not found");
-                    nodes.push_back(not_found_node);
-                }
-
-                Edge *edge = new Edge(sub_node, not_found_node);
-                edges.push_back(edge);
+                buf.resize(buf.size() * 2);
             }
 
-            return true;
-        }
-
-        if (got_version_info == false)
-        {
-            std::cerr << path << ": unrecognized line: " << line;
-            return true;
-        }
+            size_t n = fread(&buf[end], 1, buf.size() - end, fp);
 
-        // input: <path>:
-        if (f.size() == 1 && ends_with(f[0], ":"))
-        {
-            std::string field = trim_front(trim_end(f[0], ":"), "./");
+            end += n;
 
-            // we've been waiting for the ldd output to tell us what the
-            // real file's path is.
-            if (real_path_pending)
+            if (n == 0)
             {
-                DEBUG_OUT(std::cerr << "reset path " << path << " to " <<
-                    field << std::endl);
-                nodes[0]->setPath(field);
-                path = field;
-                real_path_pending = false;
+                at_eof = true;
+                failed = ferror(fp) != 0;
             }
-
-            cur_node = find_existing_node(nodes, field);
-
-            return true;
         }
+    };
 
-        // input: <shared object> (<version>) => <path>
-        if (f.size() != 4 && has_outer_parens(f[1]) && f[2] == "=>")
-        {
-            std::cerr << path << ": unrecognized line: " << line;
-            return true;
-        }
+    // hand out the last line again on the next call
+    void unread(void)
+    {
+        start = line_start;
+        scanned = 0;
+    };
 
-        std::string version(trim_outer_parens(f[1]));
-        std::string field = trim_front(f[3], "./");
-        Node *sub_node = find_existing_node(nodes, field);
+    bool error(void)
+    {
+        return failed;
+    };
+};
 
-        // add label to existing or new edge
-        Edge *edge = find_edge_from_to(edges, cur_node, sub_node);
+/*************************
+ *  String table
+ *************************/
 
-        if (edge == NULL)
-        {
-            edge = new Edge(cur_node, sub_node);
-            edges.push_back(edge);
-        }
+// StringTable interns strings, such as node paths and version labels, as
+// compact ids, so that each distinct string is stored once. It is shared
+// by all threads: interning locks, but looking up the string of an id
+// already handed out does not, as its entry never moves.
+class StringTable
+{
+ private:
+    enum
+    {
+        CHUNK_BITS = 12,
+        CHUNK_SIZE = 1 << CHUNK_BITS,
+        MAX_CHUNKS = 1 << 16
+    };
 
-        edge->addLabel(version);
+    std::map < std::string, unsigned int > ids;
+    const std::string **chunks[MAX_CHUNKS];     // id to string in ids
+    unsigned int count;
+    pthread_mutex_t lock;
 
-        return true;
+ public:
+    enum
+    {
+        ABSENT = 0xffffffff
     };
 
-    Edge *find_edge_labeled_to(Edges & edges, Node * to)
+    StringTable()
     {
-        for (Edges::iterator pn = edges.begin(); pn != edges.end(); pn++)
-        {
-            if ((*pn)->isLabeled() && (*pn)->getTo() == to)
-            {
-                return *pn;
-            }
-        }
-
-        return NULL;
+        memset(chunks, 0, sizeof(chunks));
+        count = 0;
+        pthread_mutex_init(&lock, NULL);
     };
 
-    // erase unlabeled edges with a to node for which there is a labeled
-    // edge pointing to it
-
-    void trim_unlabeled_edges(Edges & edges)
+    unsigned int intern(const std::string & s)
     {
-        DEBUG_OUT(std::cerr << "edge count " << edges.size() << std::endl);
+        pthread_mutex_lock(&lock);
 
-        Edges saved_edges;
+        std::pair < std::map < std::string, unsigned int >::iterator, bool >
+            r = ids.insert(std::make_pair(s, count));
 
-        for (Edges::iterator pe = edges.begin(); pe != edges.end(); ++pe)
+        if (r.second)
         {
-            bool keep = true;
+            unsigned int chunk = count >> CHUNK_BITS;
 
-            if (!(*pe)->isLabeled())
+            if (chunk >= MAX_CHUNKS)
             {
-                Edge *edge = find_edge_labeled_to(edges, (*pe)->getTo());
-
-                if (edge)
-                {
-                    DEBUG_OUT(std::cerr << "removing ");
-                    DEBUG_OUT((*pe)->dump());
-                    DEBUG_OUT(std::cerr << " because ");
-                    DEBUG_OUT(edge->dump());
-
-                    keep = false;
-                }
+                ids.erase(r.first);
+                pthread_mutex_unlock(&lock);
+                throw InputError("", "string table full");
             }
 
-            if (keep == true)
+            if (chunks[chunk] == NULL)
             {
-                saved_edges.push_back(*pe);
+                chunks[chunk] = new const std::string *[CHUNK_SIZE];
             }
+
+            chunks[chunk][count & (CHUNK_SIZE - 1)] = &r.first->first;
+            count++;
         }
 
-        edges = saved_edges;
-        DEBUG_OUT(std::cerr << "edge count " << edges.size() << std::endl);
+        unsigned int id = r.first->second;
+
+        pthread_mutex_unlock(&lock);
+
+        return id;
     };
 
- public:
-    Parser(std::string p)
+    // the id of a string already interned, or ABSENT, which is no id, so
+    // that a lookup adds nothing to the table
+    unsigned int find(const std::string & s)
     {
-        path = p;
-        fp = NULL;
-        is_pipe = false;
-        real_path_pending = false;
-        cur_node = NULL;
-        got_version_info = false;
-        not_found_node = NULL;
+        pthread_mutex_lock(&lock);
+
+        std::map < std::string, unsigned int >::iterator pi = ids.find(s);
+        unsigned int id = pi != ids.end() ? pi->second : (unsigned int)ABSENT;
+
+        pthread_mutex_unlock(&lock);
+
+        return id;
+    };
+
+    const std::string & get(unsigned int id)
+    {
+        return *chunks[id >> CHUNK_BITS][id & (CHUNK_SIZE - 1)];
+    };
+
+    unsigned int size(void)
+    {
+        pthread_mutex_lock(&lock);
+        unsigned int n = count;
+        pthread_mutex_unlock(&lock);
+
+        return n;
+    };
+};
+
+static StringTable strings;
+
+/*************************
+ *  Arena
+ *************************/
+
+// Arena owns objects of one type, constructed in place in contiguous
+// chunks, and destroys them all at once
+template < class T > class Arena
+{
+ private:
+    enum
+    {
+        CHUNK_SIZE = 256
+    };
+
+    std::vector < T * >chunks;
+    size_t used;                // objects constructed in the last chunk
+
+    Arena(const Arena &);
+    Arena & operator =(const Arena &);
+
+ public:
+    Arena()
+    {
+        used = CHUNK_SIZE;
+    };
+
+    ~Arena()
+    {
+        clear();
+    };
+
+    // storage for the next object, to be constructed with placement new
+    void *allocate(void)
+    {
+        if (used == CHUNK_SIZE)
+        {
+            chunks.push_back((T *)::operator new(sizeof(T) * CHUNK_SIZE));
+            used = 0;
+        }
+
+        return chunks.back() + used++;
+    };
+
+    void clear(void)
+    {
+        for (size_t i = 0; i < chunks.size(); i++)
+        {
+            size_t n = i + 1 == chunks.size() ? used : (size_t) CHUNK_SIZE;
+
+            for (size_t j = 0; j < n; j++)
+            {
+                chunks[i][j].~T();
+            }
+
+            ::operator delete(chunks[i]);
+        }
+
+        chunks.clear();
+        used = CHUNK_SIZE;
+    };
+
+    void swap(Arena & a)
+    {
+        chunks.swap(a.chunks);
+        std::swap(used, a.used);
+    };
+};
+
+/*************************
+ *  Graph model
+ *************************/
+
+unsigned int intern_string(const std::string & s)
+{
+    return strings.intern(s);
+}
+
+const std::string & interned_string(unsigned int id)
+{
+    return strings.get(id);
+}
+
+Nodes::Nodes()
+{
+    arena = new Arena < Node >;
+}
+
+Nodes::~Nodes()
+{
+    delete arena;
+}
+
+Node *Nodes::create(const std::string & path)
+{
+    Node *node = new(arena->allocate())Node(path);
+
+    DEBUG_OUT(std::cerr << "node: path " << path << std::endl);
+
+    return node;
+}
+
+void Nodes::clear(void)
+{
+    std::vector < Node * >().swap(list);
+    arena->clear();
+}
+
+Edges::Edges()
+{
+    arena = new Arena < Edge >;
+}
+
+Edges::~Edges()
+{
+    delete arena;
+}
+
+Edge *Edges::add(Node * from, Node * to)
+{
+    Edge *edge = new(arena->allocate())Edge(from, to);
+
+    DEBUG_OUT(std::cerr << "edge: from " << from->getPath() << " to " <<
+        to->getPath() << std::endl);
+    list.push_back(edge);
+
+    return edge;
+}
+
+/*************************
+ *  File helpers
+ *************************/
+
+// detect a dynamically loadable Embedded Linker Format (ELF) header:
+// the ELF Identification header is 16 bytes and is followed by the type
+// field (which indicates if it is a dynamic load object or executable).
+static bool is_ELF_header(const unsigned char *s, size_t n)
+{
+    if (n < EI_NIDENT + sizeof(Elf64_Half))
+    {
+        return false;
+    }
+
+    unsigned int type = s[EI_DATA] == ELFDATA2MSB ?
+        (s[EI_NIDENT] << 8) | s[EI_NIDENT + 1] :
+        (s[EI_NIDENT + 1] << 8) | s[EI_NIDENT];
+
+    return s[EI_MAG0] == ELFMAG0 && s[EI_MAG1] == ELFMAG1 &&
+        s[EI_MAG2] == ELFMAG2 && s[EI_MAG3] == ELFMAG3 &&
+        (s[EI_CLASS] == ELFCLASS32 || s[EI_CLASS] == ELFCLASS64) &&
+        (s[EI_DATA] == ELFDATA2LSB || s[EI_DATA] == ELFDATA2MSB) &&
+        s[EI_VERSION] == EV_CURRENT && (type == ET_DYN || type == ET_EXEC);
+}
+
+// detect dynamically loaded Embedded Linker Format (ELF) file
+static bool is_ELF_file(std::string path)
+{
+    // Open the file to determine if it is ELF
+    FILE *fp = fopen(path.c_str(), "rb");
+
+    if (fp == NULL)
+    {
+        throw InputError(path, std::string("fopen failed: ") + strerror(errno));
+    }
+
+    unsigned char s[EI_NIDENT + sizeof(Elf64_Half)];
+
+    size_t n = fread(s, 1, sizeof(s), fp);
+
+    if (n == 0)
+    {
+        int err = ferror(fp) ? errno : 0;
+
+        fclose(fp);
+        throw InputError(path, err != 0 ?
+            std::string("fread failed: ") + strerror(err) : "empty file");
+    }
+
+    fclose(fp);
+
+    // a short file or a file with the wrong MAGIC or field values is not ELF
+    if (!is_ELF_header(s, n))
+    {
+        DEBUG_OUT(std::cerr << path <<
+            ": not recognized as an ELF dynamic load input file" << std::endl);
+        return false;
+    }
+
+#if DEBUG
+    // describe the file for debug folks
+    unsigned int width = s[EI_CLASS] == ELFCLASS32 ? 32 :
+        s[EI_CLASS] == ELFCLASS64 ? 64 : 0;
+
+    std::cerr << path << ": " << width << " bits, dynamic load file"
+        << std::endl;
+#endif
+
+    return true;
+}
+
+// quote a word for the shell
+static std::string shell_quote(const std::string & s)
+{
+    std::string q("'");
+
+    for (size_t i = 0; i < s.size(); i++)
+    {
+        q += s[i] == '\'' ? std::string("'\\''") : std::string(1, s[i]);
+    }
+
+    return q + "'";
+}
+
+// push the components of a path onto a stack, the last first, skipping
+// empty and "." components
+static void split_components(const std::string & path,
+    std::vector < std::string > &stack)
+{
+    size_t end = path.size();
+
+    while (end > 0)
+    {
+        size_t start = path.rfind('/', end - 1);
+        size_t first = start == std::string::npos ? 0 : start + 1;
+
+        if (end > first && path.compare(first, end - first, ".") != 0)
+        {
+            stack.push_back(path.substr(first, end - first));
+        }
+
+        if (start == std::string::npos)
+        {
+            break;
+        }
+
+        end = start;
+    }
+}
+
+// the absolute path of components
+static std::string join_components(const std::vector < std::string >
+    &components)
+{
+    std::string path;
+
+    for (size_t i = 0; i < components.size(); i++)
+    {
+        path += "/";
+        path += components[i];
+    }
+
+    return components.empty() ? path + "/" : path;
+}
+
+// LinkSource reads the symbolic links of a file system image
+class LinkSource
+{
+ public:
+    virtual ~ LinkSource()
+    {
+    };
+
+    // the target of a link at an absolute path, false if it is no link
+    virtual bool readLink(const std::string & path, std::string & target)
+        const = 0;
+};
+
+// the absolute path a path inside an image leads to, following links as
+// ld.so running in the image would see them, so absolute targets and
+// ".." stay inside it
+static std::string resolve_links(const LinkSource & links,
+    const std::string & path)
+{
+    std::vector < std::string > done;   // components resolved so far
+    std::vector < std::string > todo;   // components left, last first
+    unsigned int count = 0;
+
+    split_components(path, todo);
+
+    while (!todo.empty())
+    {
+        std::string c(todo.back());
+        std::string target;
+
+        todo.pop_back();
+
+        if (c == "..")
+        {
+            if (!done.empty())
+            {
+                done.pop_back();
+            }
+            continue;
+        }
+
+        done.push_back(c);
+
+        // as ld.so, give up on loops after 40 links
+        if (!links.readLink(join_components(done), target) || ++count > 40)
+        {
+            continue;
+        }
+
+        done.pop_back();
+
+        if (!target.empty() && target[0] == '/')
+        {
+            done.clear();
+        }
+
+        split_components(target, todo);
+    }
+
+    return join_components(done);
+}
+
+/*************************
+ *  ELF reader
+ *************************/
+
+// RELR relocations, newer than some elf.h headers
+#ifndef DT_RELR
+#define DT_RELRSZ 35
+#define DT_RELR 36
+#endif
+
+// offset and width of a field in the 32 or 64 bit flavor of an ELF struct
+#define ELF_OFFSET(t, f) (is64 ? offsetof(Elf64_##t, f) : offsetof(Elf32_##t, f))
+#define ELF_WIDTH(t, f) (is64 ? sizeof(((Elf64_##t *)0)->f) : \
+    sizeof(((Elf32_##t *)0)->f))
+#define ELF_FIELD(base, t, f) get((base) + ELF_OFFSET(t, f), ELF_WIDTH(t, f))
+
+// a PT_LOAD segment, used to map virtual addresses to file offsets
+struct ElfSegment
+{
+    uint64_t vaddr;
+    uint64_t offset;
+    uint64_t filesz;
+};
+
+// the versions required from one needed file (DT_VERNEED)
+struct ElfVerneed
+{
+    std::string file;
+    std::vector < std::string > versions;
+};
+
+// ElfImage reads the fields of an ELF file in memory in the file's class
+// and byte order, independent of the host, and maps virtual addresses to
+// file offsets through its PT_LOAD segments. A read out of bounds, or of
+// an address no segment maps, sets bad and gives 0.
+class ElfImage
+{
+ protected:
+    const unsigned char *image; // file contents
+    size_t image_size;
+    bool bad;                   // an access was out of bounds
+    std::vector < ElfSegment > loads;
+
+    void attach(const unsigned char *data, size_t size)
+    {
+        image = data;
+        image_size = size;
+        bad = false;
+        loads.clear();
+    };
+
+    // fetch an unsigned field of width bytes in the file's byte order
+    uint64_t get(uint64_t off, size_t width)
+    {
+        if (off > image_size || width > image_size - off)
+        {
+            bad = true;
+            return 0;
+        }
+
+        uint64_t v = 0;
+
+        for (size_t i = 0; i < width; i++)
+        {
+            v = (v << 8) | image[off + (msb ? i : width - 1 - i)];
+        }
+
+        return v;
+    };
+
+    uint64_t vaddr_to_offset(uint64_t vaddr)
+    {
+        for (std::vector < ElfSegment >::iterator ps = loads.begin();
+            ps != loads.end(); ++ps)
+        {
+            if (vaddr >= ps->vaddr && vaddr - ps->vaddr < ps->filesz)
+            {
+                return ps->offset + (vaddr - ps->vaddr);
+            }
+        }
+
+        bad = true;
+        return 0;
+    };
+
+ public:
+    bool is64;                  // ELFCLASS64
+    bool msb;                   // ELFDATA2MSB
+
+    ElfImage()
+    {
+        image = NULL;
+        image_size = 0;
+        bad = false;
+        is64 = false;
+        msb = false;
+    };
+};
+
+// ElfObject holds the dynamic linking information of an ELF file, read
+// directly from its program headers and dynamic section, with the image
+// valid only during parse.
+class ElfObject:public ElfImage
+{
+ private:
+    // fetch a NUL terminated string at file offset off, limited to end
+    std::string get_string(uint64_t off, uint64_t end)
+    {
+        if (end > image_size)
+        {
+            end = image_size;
+        }
+
+        for (uint64_t i = off; i < end; i++)
+        {
+            if (image[i] == '\0')
+            {
+                return std::string((const char *)image + off, i - off);
+            }
+        }
+
+        bad = true;
+        return "";
+    };
+
+ public:
+    unsigned int type;          // e_type
+    unsigned int machine;       // e_machine
+    bool dynamic;               // has a PT_DYNAMIC segment
+    std::string interp;         // PT_INTERP
+    std::string soname;         // DT_SONAME
+    std::string rpath;          // DT_RPATH
+    std::string runpath;        // DT_RUNPATH
+    bool has_runpath;
+    std::vector < std::string > needed; // DT_NEEDED
+    std::vector < ElfVerneed > verneed; // DT_VERNEED
+    std::vector < std::string > verdef; // DT_VERDEF, except the base
+
+    ElfObject()
+    {
+        type = ET_NONE;
+        machine = EM_NONE;
+        dynamic = false;
+        has_runpath = false;
+    };
+
+    // could the loader use this object with another
+    bool compatible(const ElfObject & o)
+    {
+        return is64 == o.is64 && msb == o.msb && machine == o.machine;
+    };
+
+    bool defines_version(const std::string & v)
+    {
+        for (std::vector < std::string >::iterator pv = verdef.begin();
+            pv != verdef.end(); ++pv)
+        {
+            if (*pv == v)
+            {
+                return true;
+            }
+        }
+
+        return false;
+    };
+
+    // decode an ELF image in memory, false if it isn't a sane ELF file
+    bool parse(const unsigned char *data, size_t size)
+    {
+        attach(data, size);
+
+        if (!is_ELF_header(data, size))
+        {
+            return false;
+        }
+
+        is64 = data[EI_CLASS] == ELFCLASS64;
+        msb = data[EI_DATA] == ELFDATA2MSB;
+        type = ELF_FIELD(0, Ehdr, e_type);
+        machine = ELF_FIELD(0, Ehdr, e_machine);
+
+        uint64_t phoff = ELF_FIELD(0, Ehdr, e_phoff);
+        uint64_t phentsize = ELF_FIELD(0, Ehdr, e_phentsize);
+        uint64_t phnum = ELF_FIELD(0, Ehdr, e_phnum);
+        uint64_t dyn_off = 0;
+        uint64_t dyn_size = 0;
+
+        for (uint64_t i = 0; i < phnum && !bad; i++)
+        {
+            uint64_t ph = phoff + i * phentsize;
+            uint64_t p_type = ELF_FIELD(ph, Phdr, p_type);
+            ElfSegment seg;
+
+            seg.vaddr = ELF_FIELD(ph, Phdr, p_vaddr);
+            seg.offset = ELF_FIELD(ph, Phdr, p_offset);
+            seg.filesz = ELF_FIELD(ph, Phdr, p_filesz);
+
+            if (p_type == PT_LOAD)
+            {
+                loads.push_back(seg);
+            }
+            else if (p_type == PT_DYNAMIC)
+            {
+                dynamic = true;
+                dyn_off = seg.offset;
+                dyn_size = seg.filesz;
+            }
+            else if (p_type == PT_INTERP)
+            {
+                interp = get_string(seg.offset, seg.offset + seg.filesz);
+            }
+        }
+
+        if (bad || !dynamic)
+        {
+            return !bad;
+        }
+
+        // walk the dynamic section, strings are resolved once DT_STRTAB
+        // is known
+        std::vector < uint64_t > needed_ix;
+        uint64_t strtab = 0, strsz = 0;
+        uint64_t soname_ix = 0, rpath_ix = 0, runpath_ix = 0;
+        bool has_soname = false, has_rpath = false;
+        uint64_t verneed_addr = 0, verneed_num = 0;
+        uint64_t verdef_addr = 0, verdef_num = 0;
+        size_t dyn_ent = is64 ? sizeof(Elf64_Dyn) : sizeof(Elf32_Dyn);
+
+        for (uint64_t d = dyn_off; d + dyn_ent <= dyn_off + dyn_size; d += dyn_ent)
+        {
+            uint64_t tag = ELF_FIELD(d, Dyn, d_tag);
+            uint64_t val = ELF_FIELD(d, Dyn, d_un);
+
+            if (bad || tag == DT_NULL)
+            {
+                break;
+            }
+
+            switch (tag)
+            {
+                case DT_NEEDED:
+                    needed_ix.push_back(val);
+                    break;
+                case DT_STRTAB:
+                    strtab = val;
+                    break;
+                case DT_STRSZ:
+                    strsz = val;
+                    break;
+                case DT_SONAME:
+                    soname_ix = val;
+                    has_soname = true;
+                    break;
+                case DT_RPATH:
+                    rpath_ix = val;
+                    has_rpath = true;
+                    break;
+                case DT_RUNPATH:
+                    runpath_ix = val;
+                    has_runpath = true;
+                    break;
+                case DT_VERNEED:
+                    verneed_addr = val;
+                    break;
+                case DT_VERNEEDNUM:
+                    verneed_num = val;
+                    break;
+                case DT_VERDEF:
+                    verdef_addr = val;
+                    break;
+                case DT_VERDEFNUM:
+                    verdef_num = val;
+                    break;
+            }
+        }
+
+        if (bad || strtab == 0)
+        {
+            return !bad;
+        }
+
+        uint64_t str_off = vaddr_to_offset(strtab);
+        uint64_t str_end = str_off + strsz;
+
+#define ELF_STRING(ix) ((ix) < strsz ? get_string(str_off + (ix), str_end) : \
+    (bad = true, std::string()))
+
+        for (std::vector < uint64_t >::iterator pi = needed_ix.begin();
+            pi != needed_ix.end(); ++pi)
+        {
+            needed.push_back(ELF_STRING(*pi));
+        }
+
+        if (has_soname)
+        {
+            soname = ELF_STRING(soname_ix);
+        }
+
+        if (has_rpath)
+        {
+            rpath = ELF_STRING(rpath_ix);
+        }
+
+        if (has_runpath)
+        {
+            runpath = ELF_STRING(runpath_ix);
+        }
+
+        // Elf32_Verneed and Elf64_Verneed (and Vernaux, Verdef, Verdaux)
+        // share a layout, so the offsets below apply to either class
+        uint64_t vn = verneed_addr ? vaddr_to_offset(verneed_addr) : 0;
+
+        for (uint64_t i = 0; i < verneed_num && !bad; i++)
+        {
+            ElfVerneed need;
+            uint64_t cnt = ELF_FIELD(vn, Verneed, vn_cnt);
+            uint64_t aux = vn + ELF_FIELD(vn, Verneed, vn_aux);
+
+            need.file = ELF_STRING(ELF_FIELD(vn, Verneed, vn_file));
+
+            for (uint64_t j = 0; j < cnt && !bad; j++)
+            {
+                need.versions.push_back(ELF_STRING(ELF_FIELD(aux, Vernaux,
+                            vna_name)));
+                aux += ELF_FIELD(aux, Vernaux, vna_next);
+            }
+
+            verneed.push_back(need);
+            vn += ELF_FIELD(vn, Verneed, vn_next);
+        }
+
+        uint64_t vd = verdef_addr ? vaddr_to_offset(verdef_addr) : 0;
+
+        for (uint64_t i = 0; i < verdef_num && !bad; i++)
+        {
+            uint64_t flags = ELF_FIELD(vd, Verdef, vd_flags);
+            uint64_t aux = vd + ELF_FIELD(vd, Verdef, vd_aux);
+
+            if (!(flags & VER_FLG_BASE))
+            {
+                verdef.push_back(ELF_STRING(ELF_FIELD(aux, Verdaux, vda_name)));
+            }
+
+            vd += ELF_FIELD(vd, Verdef, vd_next);
+        }
+
+#undef ELF_STRING
+
+        return !bad;
+    };
+
+    // map and decode an ELF file, false if it can't be read or isn't ELF
+    bool read(const std::string & path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        struct stat st;
+        bool ok = false;
+
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+        {
+            void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (map != MAP_FAILED)
+            {
+                ok = parse((const unsigned char *)map, st.st_size);
+                munmap(map, st.st_size);
+            }
+        }
+
+        ::close(fd);
+        detach();
+
+        return ok;
+    };
+
+    // forget the image parsed, which the caller is about to free
+    void detach(void)
+    {
+        image = NULL;
+        image_size = 0;
+    };
+};
+
+
+// ElfSymbols looks up the dynamic symbols of an ELF file, which it keeps
+// mapped, through its DT_GNU_HASH table, or its DT_HASH table if it has
+// no GNU one.
+class ElfSymbols:private ElfImage
+{
+ private:
+    void *map;
+    size_t map_size;
+    uint64_t symtab;            // file offsets, 0 if absent
+    uint64_t strtab;
+    uint64_t strsz;
+    uint64_t gnu_hash;
+    uint64_t sysv_hash;
+    uint64_t count;             // symbols in the table
+    uint64_t rela, relasz, rela_ent;    // relocation tables
+    uint64_t rel, relsz, rel_ent;
+    uint64_t relr, relrsz;
+    uint64_t jmprel, pltrelsz, pltrel;
+    bool bind_now;
+    bool prelinked;
+    uint64_t load_size;         // PT_LOAD bytes in memory
+
+    uint64_t sym(uint64_t i)
+    {
+        return symtab + i * (is64 ? sizeof(Elf64_Sym) : sizeof(Elf32_Sym));
+    };
+
+    // the name of symbol i, or NULL
+    const char *name(uint64_t i)
+    {
+        uint64_t ix = ELF_FIELD(sym(i), Sym, st_name);
+
+        if (bad || ix >= strsz || strtab + strsz > image_size ||
+            memchr(image + strtab + ix, '\0', strsz - ix) == NULL)
+        {
+            return NULL;
+        }
+
+        return (const char *)image + strtab + ix;
+    };
+
+    // is symbol i a global definition other objects may bind to
+    bool defined(uint64_t i)
+    {
+        unsigned int info = ELF_FIELD(sym(i), Sym, st_info);
+        unsigned int bind = ELF64_ST_BIND(info);
+
+        return ELF_FIELD(sym(i), Sym, st_shndx) != SHN_UNDEF &&
+            (bind == STB_GLOBAL || bind == STB_WEAK || bind == STB_GNU_UNIQUE)
+            && !bad;
+    };
+
+    // the symbol count, which only the hash tables record
+    uint64_t table_size(void)
+    {
+        if (sysv_hash != 0)
+        {
+            return get(sysv_hash + 4, 4);
+        }
+
+        if (gnu_hash == 0)
+        {
+            return 0;
+        }
+
+        // one past the end of the chain of the highest numbered symbol
+        uint64_t nbuckets = get(gnu_hash, 4);
+        uint64_t symoffset = get(gnu_hash + 4, 4);
+        uint64_t bloom_size = get(gnu_hash + 8, 4);
+        uint64_t buckets = gnu_hash + 16 + bloom_size * (is64 ? 8 : 4);
+        uint64_t last = 0;
+
+        for (uint64_t b = 0; b < nbuckets && !bad; b++)
+        {
+            uint64_t i = get(buckets + 4 * b, 4);
+
+            if (i > last)
+            {
+                last = i;
+            }
+        }
+
+        if (last < symoffset)
+        {
+            return symoffset;
+        }
+
+        uint64_t chains = buckets + 4 * nbuckets;
+
+        while (!bad && !(get(chains + 4 * (last - symoffset), 4) & 1))
+        {
+            last++;
+        }
+
+        return bad ? 0 : last + 1;
+    };
+
+    static uint32_t gnu_hash_of(const char *s)
+    {
+        uint32_t h = 5381;
+
+        for (; *s != '\0'; s++)
+        {
+            h = h * 33 + (unsigned char)*s;
+        }
+
+        return h;
+    };
+
+    static uint32_t sysv_hash_of(const char *s)
+    {
+        uint32_t h = 0;
+
+        for (; *s != '\0'; s++)
+        {
+            h = (h << 4) + (unsigned char)*s;
+            h ^= (h >> 24) & 0xf0;
+        }
+
+        return h & 0x0fffffff;
+    };
+
+    bool is(uint64_t i, const char *s)
+    {
+        const char *n = name(i);
+
+        return n != NULL && strcmp(n, s) == 0 && defined(i);
+    };
+
+    bool gnu_lookup(const char *s)
+    {
+        uint32_t h = gnu_hash_of(s);
+        uint64_t nbuckets = get(gnu_hash, 4);
+        uint64_t symoffset = get(gnu_hash + 4, 4);
+        uint64_t bloom_size = get(gnu_hash + 8, 4);
+        unsigned int shift = get(gnu_hash + 12, 4);
+        unsigned int bits = is64 ? 64 : 32;
+
+        if (bad || nbuckets == 0 || bloom_size == 0)
+        {
+            return false;
+        }
+
+        uint64_t word = get(gnu_hash + 16 + (h / bits % bloom_size) *
+            (bits / 8), bits / 8);
+        uint64_t mask = (uint64_t) 1 << (h % bits) |
+            (uint64_t) 1 << ((h >> shift) % bits);
+
+        if ((word & mask) != mask)
+        {
+            return false;
+        }
+
+        uint64_t buckets = gnu_hash + 16 + bloom_size * (bits / 8);
+        uint64_t chains = buckets + 4 * nbuckets;
+        uint64_t i = get(buckets + 4 * (h % nbuckets), 4);
+
+        if (i < symoffset)
+        {
+            return false;
+        }
+
+        for (; !bad; i++)
+        {
+            uint32_t h2 = get(chains + 4 * (i - symoffset), 4);
+
+            if ((h | 1) == (h2 | 1) && is(i, s))
+            {
+                return true;
+            }
+
+            if (h2 & 1)
+            {
+                break;
+            }
+        }
+
+        return false;
+    };
+
+    bool sysv_lookup(const char *s)
+    {
+        uint64_t nbucket = get(sysv_hash, 4);
+        uint64_t nchain = get(sysv_hash + 4, 4);
+
+        if (bad || nbucket == 0)
+        {
+            return false;
+        }
+
+        uint64_t chains = sysv_hash + 8 + 4 * nbucket;
+        uint64_t i = get(sysv_hash + 8 + 4 * (sysv_hash_of(s) % nbucket), 4);
+
+        // the chain bound guards against loops in a corrupt table
+        for (uint64_t n = 0; i != STN_UNDEF && n < nchain && !bad; n++)
+        {
+            if (is(i, s))
+            {
+                return true;
+            }
+
+            i = get(chains + 4 * i, 4);
+        }
+
+        return false;
+    };
+
+ public:
+    ElfSymbols()
+    {
+        map = NULL;
+        map_size = 0;
+        symtab = strtab = strsz = gnu_hash = sysv_hash = count = 0;
+        rela = relasz = rela_ent = rel = relsz = rel_ent = 0;
+        relr = relrsz = jmprel = pltrelsz = pltrel = 0;
+        bind_now = prelinked = false;
+        load_size = 0;
+    };
+
+    ~ElfSymbols()
+    {
+        if (map != NULL)
+        {
+            munmap(map, map_size);
+        }
+    };
+
+    // map a file and find its dynamic symbol table, false if it has none
+    bool open(const std::string & path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        struct stat st;
+
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+        {
+            map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (map == MAP_FAILED)
+            {
+                map = NULL;
+            }
+            else
+            {
+                map_size = st.st_size;
+            }
+        }
+
+        ::close(fd);
+
+        if (map == NULL || !is_ELF_header((const unsigned char *)map,
+                map_size))
+        {
+            return false;
+        }
+
+        attach((const unsigned char *)map, map_size);
+        is64 = image[EI_CLASS] == ELFCLASS64;
+        msb = image[EI_DATA] == ELFDATA2MSB;
+
+        uint64_t phoff = ELF_FIELD(0, Ehdr, e_phoff);
+        uint64_t phentsize = ELF_FIELD(0, Ehdr, e_phentsize);
+        uint64_t phnum = ELF_FIELD(0, Ehdr, e_phnum);
+        uint64_t dyn_off = 0, dyn_size = 0;
+
+        for (uint64_t i = 0; i < phnum && !bad; i++)
+        {
+            uint64_t ph = phoff + i * phentsize;
+            uint64_t p_type = ELF_FIELD(ph, Phdr, p_type);
+            ElfSegment seg;
+
+            seg.vaddr = ELF_FIELD(ph, Phdr, p_vaddr);
+            seg.offset = ELF_FIELD(ph, Phdr, p_offset);
+            seg.filesz = ELF_FIELD(ph, Phdr, p_filesz);
+
+            if (p_type == PT_LOAD)
+            {
+                loads.push_back(seg);
+                load_size += ELF_FIELD(ph, Phdr, p_memsz);
+            }
+            else if (p_type == PT_DYNAMIC)
+            {
+                dyn_off = seg.offset;
+                dyn_size = seg.filesz;
+            }
+        }
+
+        size_t dyn_ent = is64 ? sizeof(Elf64_Dyn) : sizeof(Elf32_Dyn);
+
+        for (uint64_t d = dyn_off; d + dyn_ent <= dyn_off + dyn_size;
+            d += dyn_ent)
+        {
+            uint64_t tag = ELF_FIELD(d, Dyn, d_tag);
+            uint64_t val = ELF_FIELD(d, Dyn, d_un);
+
+            if (bad || tag == DT_NULL)
+            {
+                break;
+            }
+
+            switch (tag)
+            {
+                case DT_SYMTAB:
+                    symtab = vaddr_to_offset(val);
+                    break;
+                case DT_STRTAB:
+                    strtab = vaddr_to_offset(val);
+                    break;
+                case DT_STRSZ:
+                    strsz = val;
+                    break;
+                case DT_GNU_HASH:
+                    gnu_hash = vaddr_to_offset(val);
+                    break;
+                case DT_HASH:
+                    sysv_hash = vaddr_to_offset(val);
+                    break;
+                case DT_RELA:
+                    rela = vaddr_to_offset(val);
+                    break;
+                case DT_RELASZ:
+                    relasz = val;
+                    break;
+                case DT_RELAENT:
+                    rela_ent = val;
+                    break;
+                case DT_REL:
+                    rel = vaddr_to_offset(val);
+                    break;
+                case DT_RELSZ:
+                    relsz = val;
+                    break;
+                case DT_RELENT:
+                    rel_ent = val;
+                    break;
+                case DT_RELR:
+                    relr = vaddr_to_offset(val);
+                    break;
+                case DT_RELRSZ:
+                    relrsz = val;
+                    break;
+                case DT_JMPREL:
+                    jmprel = vaddr_to_offset(val);
+                    break;
+                case DT_PLTRELSZ:
+                    pltrelsz = val;
+                    break;
+                case DT_PLTREL:
+                    pltrel = val;
+                    break;
+                case DT_BIND_NOW:
+                    bind_now = true;
+                    break;
+                case DT_FLAGS:
+                    bind_now = bind_now || (val & DF_BIND_NOW);
+                    break;
+                case DT_FLAGS_1:
+                    bind_now = bind_now || (val & DF_1_NOW);
+                    break;
+                case DT_GNU_PRELINKED:
+                    prelinked = true;
+                    break;
+            }
+        }
+
+        if (bad || symtab == 0 || strtab == 0)
+        {
+            return false;
+        }
+
+        count = table_size();
+
+        return !bad;
+    };
+
+    // count the relocations of a table of count entries of entry bytes,
+    // by whether they refer to a symbol
+    void count_relocs(uint64_t off, uint64_t size, uint64_t entry,
+        uint64_t & relative, uint64_t & symbolic)
+    {
+        if (off == 0 || entry == 0)
+        {
+            return;
+        }
+
+        for (uint64_t r = off; r + entry <= off + size && !bad; r += entry)
+        {
+            uint64_t info = is64 ? get(r + 8, 8) : get(r + 4, 4);
+            uint64_t symbol = is64 ? info >> 32 : info >> 8;
+
+            if (symbol == 0)
+            {
+                relative++;
+            }
+            else
+            {
+                symbolic++;
+            }
+        }
+    };
+
+    // the load cost of the file: relocations, binding and mapped size
+    void cost(LoadCost & c)
+    {
+        uint64_t plt_off = jmprel, plt_size = pltrelsz;
+        uint64_t plt_entry = pltrel == DT_RELA ? rela_ent : rel_ent;
+        uint64_t plt_relative = 0;
+
+        c.measured = true;
+        c.bind_now = bind_now;
+        c.prelinked = prelinked;
+        c.load_size = load_size;
+
+        // some linkers count DT_JMPREL in DT_RELASZ or DT_RELSZ
+        uint64_t rela_size = relasz, rel_size = relsz;
+
+        if (plt_off != 0 && pltrel == DT_RELA && plt_off >= rela &&
+            plt_off + plt_size == rela + relasz)
+        {
+            rela_size -= plt_size;
+        }
+        else if (plt_off != 0 && pltrel == DT_REL && plt_off >= rel &&
+            plt_off + plt_size == rel + relsz)
+        {
+            rel_size -= plt_size;
+        }
+
+        count_relocs(rela, rela_size, rela_ent, c.relative, c.symbolic);
+        count_relocs(rel, rel_size, rel_ent, c.relative, c.symbolic);
+        count_relocs(plt_off, plt_size, plt_entry, plt_relative, c.plt);
+        c.relative += plt_relative;
+
+        // RELR entries are an address, then bitmaps of the words after it
+        size_t word = is64 ? 8 : 4;
+
+        for (uint64_t r = relr; relr != 0 && r + word <= relr + relrsz &&
+            !bad; r += word)
+        {
+            uint64_t e = get(r, word);
+
+            if (!(e & 1))
+            {
+                c.relative++;
+                continue;
+            }
+
+            for (e >>= 1; e != 0; e >>= 1)
+            {
+                c.relative += e & 1;
+            }
+        }
+
+        // each symbolic relocation is a lookup, and with BIND_NOW so is
+        // each PLT relocation
+        c.lookups = c.symbolic + (bind_now ? c.plt : 0);
+    };
+
+    // the names of the global symbols the file needs from others
+    void undefined(std::vector < const char *>&names)
+    {
+        for (uint64_t i = 1; i < count && !bad; i++)
+        {
+            unsigned int info = ELF_FIELD(sym(i), Sym, st_info);
+            unsigned int bind = ELF64_ST_BIND(info);
+            const char *n = name(i);
+
+            if (ELF_FIELD(sym(i), Sym, st_shndx) == SHN_UNDEF &&
+                bind != STB_LOCAL && n != NULL && *n != '\0')
+            {
+                names.push_back(n);
+            }
+        }
+    };
+
+    // does the file define a global symbol
+    bool defines(const char *s)
+    {
+        if (gnu_hash != 0)
+        {
+            return gnu_lookup(s);
+        }
+
+        if (sysv_hash != 0)
+        {
+            return sysv_lookup(s);
+        }
+
+        return false;
+    };
+};
+
+#undef ELF_FIELD
+#undef ELF_WIDTH
+#undef ELF_OFFSET
+
+/*************************
+ *  Object cache
+ *************************/
+
+// identity of a file's contents: a changed file gets a new key
+struct FileKey
+{
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    uint64_t mtime_sec;
+    uint64_t mtime_nsec;
+
+    bool operator <(const FileKey & k) const
+    {
+        if (dev != k.dev)
+        {
+            return dev < k.dev;
+        }
+
+        if (ino != k.ino)
+        {
+            return ino < k.ino;
+        }
+
+        if (size != k.size)
+        {
+            return size < k.size;
+        }
+
+        if (mtime_sec != k.mtime_sec)
+        {
+            return mtime_sec < k.mtime_sec;
+        }
+
+        return mtime_nsec < k.mtime_nsec;
+    };
+};
+
+// a cached read of one object: its path, and whether it was a usable
+// ELF file, and if so its dynamic linking information
+struct CacheRecord
+{
+    std::string path;
+    bool ok;
+    ElfObject elf;
+    bool used;                  // read or added in this run
+};
+
+// a field of a cache file line, with the tabs, newlines and backslashes
+// of a string escaped so that it stays one field
+static std::string escape_field(const std::string & s)
+{
+    std::string e;
+
+    for (size_t i = 0; i < s.size(); i++)
+    {
+        if (s[i] == '\t')
+        {
+            e += "\\t";
+        }
+        else if (s[i] == '\n')
+        {
+            e += "\\n";
+        }
+        else if (s[i] == '\\')
+        {
+            e += "\\\\";
+        }
+        else
+        {
+            e += s[i];
+        }
+    }
+
+    return e;
+}
+
+// undo escape_field, false for an escape it does not write
+static bool unescape_field(const std::string & e, std::string & s)
+{
+    s.clear();
+
+    for (size_t i = 0; i < e.size(); i++)
+    {
+        if (e[i] != '\\')
+        {
+            s += e[i];
+            continue;
+        }
+
+        if (++i == e.size())
+        {
+            return false;
+        }
+
+        if (e[i] == 't')
+        {
+            s += '\t';
+        }
+        else if (e[i] == 'n')
+        {
+            s += '\n';
+        }
+        else if (e[i] == '\\')
+        {
+            s += '\\';
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// split a line on tabs into its unescaped fields, false if one is
+// malformed
+static bool split_tabs(const std::string & line,
+    std::vector < std::string > &f)
+{
+    size_t start = 0;
+
+    f.clear();
+
+    for (size_t i = 0; i <= line.size(); i++)
+    {
+        if (i == line.size() || line[i] == '\t')
+        {
+            f.push_back(std::string());
+
+            if (!unescape_field(line.substr(start, i - start), f.back()))
+            {
+                return false;
+            }
+
+            start = i + 1;
+        }
+    }
+
+    return true;
+}
+
+// ObjectCache keeps the ELF reads of objects across runs in a file,
+// keyed by (dev, inode, size, mtime) so that a changed file is re-read.
+// Only one record is kept for each path, so the file does not grow with
+// every update of the objects it describes. It is shared by the batch
+// workers. With no file it is kept in memory only.
+class ObjectCache
+{
+ private:
+    std::string file;           // cache file pathname
+    std::map < FileKey, CacheRecord > records;
+    bool dirty;                 // records were added since load
+    pthread_mutex_t lock;
+
+    static const char *magic(void)
+    {
+        return "lddgraph-cache 2";
+    };
+
+ public:
+    ObjectCache(std::string f)
+    {
+        file = f;
+        dirty = false;
+        pthread_mutex_init(&lock, NULL);
+    };
+
+    ~ObjectCache()
+    {
+        pthread_mutex_destroy(&lock);
+    };
+
+    // read the cache file, a missing or foreign file is an empty cache
+    void load(void)
+    {
+        std::ifstream in(file.c_str());
+        std::string line;
+
+        if (file.empty() || !std::getline(in, line) || line != magic())
+        {
+            return;
+        }
+
+        CacheRecord *rec = NULL;
+        std::vector < std::string > f;
+
+        while (std::getline(in, line))
+        {
+            // a line that cannot be read leaves the lines after it, up to
+            // the next object, with no object to describe
+            if (!split_tabs(line, f))
+            {
+                rec = NULL;
+            }
+            // O dev ino size mtime nsec ok class data machine type dynamic path
+            else if (f[0] == "O" && f.size() == 13)
+            {
+                FileKey key;
+
+                key.dev = strtoull(f[1].c_str(), NULL, 10);
+                key.ino = strtoull(f[2].c_str(), NULL, 10);
+                key.size = strtoull(f[3].c_str(), NULL, 10);
+                key.mtime_sec = strtoull(f[4].c_str(), NULL, 10);
+                key.mtime_nsec = strtoull(f[5].c_str(), NULL, 10);
+                rec = &records[key];
+                rec->used = false;
+                rec->ok = f[6] == "1";
+                rec->elf.is64 = f[7] == "64";
+                rec->elf.msb = f[8] == "msb";
+                rec->elf.machine = strtoul(f[9].c_str(), NULL, 10);
+                rec->elf.type = strtoul(f[10].c_str(), NULL, 10);
+                rec->elf.dynamic = f[11] == "1";
+                rec->path = f[12];
+            }
+            else if (rec == NULL)
+            {
+                continue;
+            }
+            else if (f.size() < 2 || f[0] == "O")
+            {
+                rec = NULL;
+            }
+            else if (f[0] == "I")
+            {
+                rec->elf.interp = f[1];
+            }
+            else if (f[0] == "S")
+            {
+                rec->elf.soname = f[1];
+            }
+            else if (f[0] == "R")
+            {
+                rec->elf.rpath = f[1];
+            }
+            else if (f[0] == "U")
+            {
+                rec->elf.runpath = f[1];
+                rec->elf.has_runpath = true;
+            }
+            else if (f[0] == "N")
+            {
+                rec->elf.needed.push_back(f[1]);
+            }
+            else if (f[0] == "V")
+            {
+                ElfVerneed need;
+
+                need.file = f[1];
+                need.versions.assign(f.begin() + 2, f.end());
+                rec->elf.verneed.push_back(need);
+            }
+            else if (f[0] == "D")
+            {
+                rec->elf.verdef.push_back(f[1]);
+            }
+            else
+            {
+                rec = NULL;
+            }
+        }
+    };
+
+    // should a record replace another for the same path: one used in this
+    // run is the file as it is now, else the one modified last
+    static bool newer(std::map < FileKey, CacheRecord >::iterator a,
+        std::map < FileKey, CacheRecord >::iterator b)
+    {
+        if (a->second.used != b->second.used)
+        {
+            return a->second.used;
+        }
+
+        if (a->first.mtime_sec != b->first.mtime_sec)
+        {
+            return a->first.mtime_sec > b->first.mtime_sec;
+        }
+
+        return a->first.mtime_nsec > b->first.mtime_nsec;
+    };
+
+    // write the cache file if it changed, replacing it atomically, with
+    // the newest record of each path
+    void save(void)
+    {
+        if (!dirty || file.empty())
+        {
+            return;
+        }
+
+        std::map < std::string, std::map < FileKey,
+            CacheRecord >::iterator > latest;
+
+        for (std::map < FileKey, CacheRecord >::iterator pr = records.begin();
+            pr != records.end(); ++pr)
+        {
+            std::map < std::string, std::map < FileKey,
+                CacheRecord >::iterator >::iterator pl =
+                latest.find(pr->second.path);
+
+            if (pl == latest.end())
+            {
+                latest.insert(std::make_pair(pr->second.path, pr));
+            }
+            else if (newer(pr, pl->second))
+            {
+                pl->second = pr;
+            }
+        }
+
+        std::string tmp(file + ".tmp");
+        std::ofstream out(tmp.c_str());
+
+        out << magic() << "\n";
+
+        for (std::map < FileKey, CacheRecord >::iterator pr = records.begin();
+            pr != records.end(); ++pr)
+        {
+            const FileKey & k = pr->first;
+            CacheRecord & r = pr->second;
+
+            if (latest[r.path] != pr)
+            {
+                continue;
+            }
+
+            out << "O\t" << k.dev << "\t" << k.ino << "\t" << k.size <<
+                "\t" << k.mtime_sec << "\t" << k.mtime_nsec << "\t" <<
+                r.ok << "\t" << (r.elf.is64 ? "64" : "32") << "\t" <<
+                (r.elf.msb ? "msb" : "lsb") << "\t" << r.elf.machine <<
+                "\t" << r.elf.type << "\t" << r.elf.dynamic << "\t" <<
+                escape_field(r.path) << "\n";
+
+            if (!r.elf.interp.empty())
+            {
+                out << "I\t" << escape_field(r.elf.interp) << "\n";
+            }
+
+            if (!r.elf.soname.empty())
+            {
+                out << "S\t" << escape_field(r.elf.soname) << "\n";
+            }
+
+            if (!r.elf.rpath.empty())
+            {
+                out << "R\t" << escape_field(r.elf.rpath) << "\n";
+            }
+
+            if (r.elf.has_runpath)
+            {
+                out << "U\t" << escape_field(r.elf.runpath) << "\n";
+            }
+
+            for (std::vector < std::string >::iterator pn =
+                r.elf.needed.begin(); pn != r.elf.needed.end(); ++pn)
+            {
+                out << "N\t" << escape_field(*pn) << "\n";
+            }
+
+            for (std::vector < ElfVerneed >::iterator pv =
+                r.elf.verneed.begin(); pv != r.elf.verneed.end(); ++pv)
+            {
+                out << "V\t" << escape_field(pv->file);
+
+                for (std::vector < std::string >::iterator ps =
+                    pv->versions.begin(); ps != pv->versions.end(); ++ps)
+                {
+                    out << "\t" << escape_field(*ps);
+                }
+
+                out << "\n";
+            }
+
+            for (std::vector < std::string >::iterator pd =
+                r.elf.verdef.begin(); pd != r.elf.verdef.end(); ++pd)
+            {
+                out << "D\t" << escape_field(*pd) << "\n";
+            }
+        }
+
+        out.close();
+
+        if (!out || rename(tmp.c_str(), file.c_str()) != 0)
+        {
+            std::cerr << file << ": cannot write cache: " << strerror(errno) <<
+                std::endl;
+            unlink(tmp.c_str());
+        }
+    };
+
+    // read an ELF file through the cache, as ElfObject::read does
+    bool read(const std::string & path, ElfObject & elf)
+    {
+        struct stat st;
+
+        if (stat(path.c_str(), &st) != 0)
+        {
+            return false;
+        }
+
+        FileKey key;
+
+        key.dev = st.st_dev;
+        key.ino = st.st_ino;
+        key.size = st.st_size;
+        key.mtime_sec = st.st_mtim.tv_sec;
+        key.mtime_nsec = st.st_mtim.tv_nsec;
+
+        pthread_mutex_lock(&lock);
+
+        std::map < FileKey, CacheRecord >::iterator pr = records.find(key);
+
+        if (pr != records.end())
+        {
+            elf = pr->second.elf;
+            bool ok = pr->second.ok;
+
+            pr->second.used = true;
+
+            pthread_mutex_unlock(&lock);
+            return ok;
+        }
+
+        pthread_mutex_unlock(&lock);
+
+        CacheRecord rec;
+
+        rec.path = path;
+        rec.ok = rec.elf.read(path);
+        rec.used = true;
+        elf = rec.elf;
+
+        pthread_mutex_lock(&lock);
+        records.insert(std::make_pair(key, rec));
+        dirty = true;
+        pthread_mutex_unlock(&lock);
+
+        return rec.ok;
+    };
+};
+
+ObjectCache *open_object_cache(const std::string & file)
+{
+    ObjectCache *cache = new ObjectCache(file);
+
+    cache->load();
+
+    return cache;
+}
+
+void save_object_cache(ObjectCache * cache)
+{
+    cache->save();
+}
+
+void close_object_cache(ObjectCache * cache)
+{
+    delete cache;
+}
+
+/*************************
+ *  Image archives
+ *************************/
+
+// ImageArchive is a file system image read from tar archives, such as
+// the layers of an OCI image, in one pass over each stream and without
+// unpacking anything to disk. Only what the loader needs is kept, by
+// absolute path in the image: the dynamic linking information of the ELF
+// members, the symbolic and hard links, and the ld.so configuration.
+// Other members are skipped as they stream past. Layers read in turn
+// replace the files of those before, and their whiteouts delete them.
+class ImageArchive:public LinkSource
+{
+ private:
+    enum
+    {
+        BLOCK = 512
+    };
+
+    std::map < std::string, ElfObject > objects;        // ELF members
+    std::map < std::string, std::string > links;        // link targets
+    std::map < std::string, std::string > files;        // ld.so config
+    std::vector < std::string > order;  // ELF members in archive order
+
+    // a header field up to its NUL
+    static std::string field(const unsigned char *f, size_t n)
+    {
+        size_t len = 0;
+
+        while (len < n && f[len] != '\0')
+        {
+            len++;
+        }
+
+        return std::string((const char *)f, len);
+    };
+
+    // a numeric header field: octal, or GNU base 256 with the high bit set
+    static uint64_t number(const unsigned char *f, size_t n)
+    {
+        uint64_t v = 0;
+        size_t i = 0;
+
+        if (n > 0 && (f[0] & 0x80))
+        {
+            for (v = f[0] & 0x7f, i = 1; i < n; i++)
+            {
+                v = (v << 8) | f[i];
+            }
+
+            return v;
+        }
+
+        while (i < n && f[i] == ' ')
+        {
+            i++;
+        }
+
+        for (; i < n && f[i] >= '0' && f[i] <= '7'; i++)
+        {
+            v = (v << 3) | (f[i] - '0');
+        }
+
+        return v;
+    };
+
+    static bool checksum_ok(const unsigned char *h)
+    {
+        uint64_t sum = 0;
+
+        for (size_t i = 0; i < BLOCK; i++)
+        {
+            sum += i >= 148 && i < 156 ? ' ' : h[i];
+        }
+
+        return sum == number(h + 148, 8);
+    };
+
+    // the absolute path in the image of a member name
+    static std::string member_path(const std::string & name)
+    {
+        std::vector < std::string > c;
+
+        split_components(name, c);
+        std::reverse(c.begin(), c.end());
+
+        return join_components(c);
+    };
+
+    // read the data of a member, padded to whole blocks, keeping its
+    // first keep bytes in data
+    static bool read_data(FILE * fp, uint64_t size, uint64_t keep,
+        std::string & data)
+    {
+        char buf[64 * BLOCK];
+        uint64_t left = (size + BLOCK - 1) / BLOCK * BLOCK;
+
+        data.clear();
+
+        while (left > 0)
+        {
+            size_t n = fread(buf, 1, std::min < uint64_t > (left, sizeof(buf)),
+                fp);
+
+            if (n == 0)
+            {
+                return false;
+            }
+
+            if (data.size() < keep)
+            {
+                data.append(buf, std::min < uint64_t > (n, keep - data.size()));
+            }
+
+            left -= n;
+        }
+
+        return true;
+    };
+
+    // apply the values of pax extended header records "len key=value\n"
+    static void pax_records(const std::string & data, std::string & path,
+        std::string & link, uint64_t & size, bool & has_size)
+    {
+        size_t pos = 0;
+
+        while (pos < data.size())
+        {
+            size_t space = data.find(' ', pos);
+            size_t len = strtoul(data.c_str() + pos, NULL, 10);
+
+            if (space == std::string::npos || len == 0 ||
+                len > data.size() - pos)
+            {
+                break;
+            }
+
+            std::string rec(data.substr(space + 1, pos + len - space - 2));
+            size_t eq = rec.find('=');
+
+            if (eq != std::string::npos)
+            {
+                std::string key(rec.substr(0, eq));
+
+                if (key == "path")
+                {
+                    path = rec.substr(eq + 1);
+                }
+                else if (key == "linkpath")
+                {
+                    link = rec.substr(eq + 1);
+                }
+                else if (key == "size")
+                {
+                    size = strtoull(rec.c_str() + eq + 1, NULL, 10);
+                    has_size = true;
+                }
+            }
+
+            pos += len;
+        }
+    };
+
+    // the ld.so configuration is kept along with the ELF members
+    static bool is_ld_so_file(const std::string & path)
+    {
+        return path.compare(0, 11, "/etc/ld.so.") == 0;
+    };
+
+    // drop what the image had at a path, for a new member or a whiteout
+    void remove(const std::string & path)
+    {
+        objects.erase(path);
+        links.erase(path);
+        files.erase(path);
+    };
+
+    // a whiteout ".wh.name" deletes name from the layers below, and an
+    // opaque ".wh..wh..opq" everything below its directory
+    void whiteout(const std::string & path)
+    {
+        size_t slash = path.rfind('/');
+        std::string dir(path.substr(0, slash + 1));
+        std::string name(path.substr(slash + 5));
+
+        if (name == ".wh..opq")
+        {
+            remove_under(objects, dir);
+            remove_under(links, dir);
+            remove_under(files, dir);
+        }
+        else
+        {
+            remove(dir + name);
+            remove_under(objects, dir + name + "/");
+            remove_under(links, dir + name + "/");
+            remove_under(files, dir + name + "/");
+        }
+    };
+
+    template < class T > static void remove_under(std::map < std::string,
+        T > &m, const std::string & dir)
+    {
+        typename std::map < std::string, T >::iterator pm =
+            m.lower_bound(dir);
+
+        while (pm != m.end() && pm->first.compare(0, dir.size(), dir) == 0)
+        {
+            m.erase(pm++);
+        }
+    };
+
+    static void fclose_or_pclose(FILE * fp, bool is_pipe)
+    {
+        if (is_pipe)
+        {
+            pclose(fp);
+        }
+        else if (fp != stdin)
+        {
+            fclose(fp);
+        }
+    };
+
+    // add a regular member, its data read from the stream
+    bool add_file(FILE * fp, const std::string & path, uint64_t size)
+    {
+        uint64_t first = std::min < uint64_t > (size, BLOCK);
+        std::string data, rest;
+
+        // the first block tells ELF members apart, as is_ELF_file does
+        if (!read_data(fp, first, first, data))
+        {
+            return false;
+        }
+
+        bool is_elf = is_ELF_header((const unsigned char *)data.data(),
+            data.size());
+
+        if (!is_elf && !is_ld_so_file(path))
+        {
+            return read_data(fp, size - first, 0, rest);
+        }
+
+        if (!read_data(fp, size - first, size - first, rest))
+        {
+            return false;
+        }
+
+        data += rest;
+        remove(path);
+
+        if (!is_elf)
+        {
+            files[path] = data;
+            return true;
+        }
+
+        ElfObject elf;
+
+        if (elf.parse((const unsigned char *)data.data(), data.size()))
+        {
+            elf.detach();
+            objects[path] = elf;
+            order.push_back(path);
+        }
+        else
+        {
+            DEBUG_OUT(std::cerr << path << ": bad ELF member" << std::endl);
+        }
+
+        return true;
+    };
+
+ public:
+    // read a tar archive, - for stdin, adding its members to the image;
+    // compressed files are read through their decompressor
+    bool read(const std::string & file)
+    {
+        FILE *fp = file == "-" ? stdin : fopen(file.c_str(), "rb");
+        bool is_pipe = false;
+
+        if (fp == NULL)
+        {
+            std::cerr << file << ": fopen: " << strerror(errno) << std::endl;
+            return false;
+        }
+
+        if (fp != stdin)
+        {
+            unsigned char m[6];
+            size_t n = fread(m, 1, sizeof(m), fp);
+            const char *tool = n >= 2 && m[0] == 0x1f && m[1] == 0x8b ?
+                "gzip" : n >= 4 && memcmp(m, "\x28\xb5\x2f\xfd", 4) == 0 ?
+                "zstd" : n >= 6 && memcmp(m, "\xfd" "7zXZ", 6) == 0 ? "xz" :
+                NULL;
+
+            if (tool != NULL)
+            {
+                std::string cmd(std::string(tool) + " -dc < " +
+                    shell_quote(file));
+
+                fclose(fp);
+                fp = popen(cmd.c_str(), "r");
+                is_pipe = true;
+
+                if (fp == NULL)
+                {
+                    std::cerr << file << ": popen: " << strerror(errno) <<
+                        std::endl;
+                    return false;
+                }
+            }
+            else
+            {
+                rewind(fp);
+            }
+        }
+
+        unsigned char h[BLOCK];
+        std::string long_path, long_link;       // for the next member
+        uint64_t pax_size = 0;
+        bool has_pax_size = false;
+        bool ended = false, bad = false;
+
+        while (!bad && fread(h, 1, BLOCK, fp) == BLOCK)
+        {
+            // the archive ends with zero blocks
+            if (h[0] == '\0' && number(h + 148, 8) == 0)
+            {
+                ended = true;
+                break;
+            }
+
+            if (!checksum_ok(h))
+            {
+                std::cerr << file << ": not a tar archive" << std::endl;
+                fclose_or_pclose(fp, is_pipe);
+                return false;
+            }
+
+            uint64_t size = has_pax_size ? pax_size : number(h + 124, 12);
+            char type = h[156];
+            std::string name(field(h, 100));
+            std::string link(field(h + 157, 100));
+            std::string data;
+
+            // POSIX ustar splits long names into a prefix and a name
+            if (memcmp(h + 257, "ustar", 6) == 0 && h[345] != '\0')
+            {
+                name = field(h + 345, 155) + "/" + name;
+            }
+
+            // GNU long names and links, and pax records, describe the
+            // member after them
+            if (type == 'L' || type == 'K' || type == 'x')
+            {
+                bad = !read_data(fp, size, size, data);
+
+                if (type == 'L')
+                {
+                    long_path = field((const unsigned char *)data.data(),
+                        data.size());
+                }
+                else if (type == 'K')
+                {
+                    long_link = field((const unsigned char *)data.data(),
+                        data.size());
+                }
+                else
+                {
+                    pax_records(data, long_path, long_link, pax_size,
+                        has_pax_size);
+                }
+                continue;
+            }
+
+            std::string path(member_path(long_path.empty() ? name :
+                    long_path));
+
+            link = long_link.empty() ? link : long_link;
+            long_path.clear();
+            long_link.clear();
+            has_pax_size = false;
+
+            if (path.compare(path.rfind('/') + 1, 4, ".wh.") == 0)
+            {
+                whiteout(path);
+                bad = !read_data(fp, size, 0, data);
+            }
+            else if (type == '0' || type == '\0' || type == '7')
+            {
+                bad = !add_file(fp, path, size);
+            }
+            else
+            {
+                // hard links name another member, symbolic links a path
+                if (type == '1' || type == '2')
+                {
+                    remove(path);
+                    links[path] = type == '1' ? member_path(link) : link;
+                }
+
+                bad = !read_data(fp, size, 0, data);
+            }
+        }
+
+        if (!ended)
+        {
+            std::cerr << file << ": truncated tar archive" << std::endl;
+        }
+
+        fclose_or_pclose(fp, is_pipe);
+
+        return ended;
+    };
+
+    // read an ELF member, following links
+    bool readObject(const std::string & path, ElfObject & elf) const
+    {
+        std::map < std::string, ElfObject >::const_iterator po =
+            objects.find(resolve_links(*this, path));
+
+        if (po == objects.end())
+        {
+            return false;
+        }
+
+        elf = po->second;
+
+        return true;
+    };
+
+    // the contents of an ld.so configuration file, following links
+    bool readFile(const std::string & path, std::string & data) const
+    {
+        std::map < std::string, std::string >::const_iterator pf =
+            files.find(resolve_links(*this, path));
+
+        if (pf == files.end())
+        {
+            return false;
+        }
+
+        data = pf->second;
+
+        return true;
+    };
+
+    // the ld.so configuration files matching a glob pattern, sorted
+    void glob(const std::string & pattern, std::vector < std::string > &paths)
+        const
+    {
+        for (std::map < std::string, std::string >::const_iterator pf =
+            files.begin(); pf != files.end(); ++pf)
+        {
+            if (fnmatch(pattern.c_str(), pf->first.c_str(), FNM_PATHNAME) == 0)
+            {
+                paths.push_back(pf->first);
+            }
+        }
+    };
+
+    bool readLink(const std::string & path, std::string & target) const
+    {
+        std::map < std::string, std::string >::const_iterator pl =
+            links.find(path);
+
+        if (pl == links.end())
+        {
+            return false;
+        }
+
+        target = pl->second;
+
+        return true;
+    };
+
+    // the dynamically linked executables, those with an interpreter and
+    // no soname, in archive order
+    void executables(std::vector < std::string > &paths) const
+    {
+        std::set < std::string > seen;
+
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            std::map < std::string, ElfObject >::const_iterator po =
+                objects.find(order[i]);
+
+            if (po != objects.end() && po->second.dynamic &&
+                !po->second.interp.empty() && po->second.soname.empty() &&
+                seen.insert(order[i]).second)
+            {
+                paths.push_back(order[i]);
+            }
+        }
+    };
+};
+
+/*************************
+ *  Statistics
+ *************************/
+
+// seconds on a monotonic clock
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*************************
+ *  Options
+ *************************/
+
+// what to do with a needed object, by its name
+enum Filter
+{ FILTER_FOLLOW, FILTER_DROP, FILTER_FOLD };
+
+// does a glob pattern of a list match a name, or the file name of a path;
+// the first that does is returned in match
+static bool match_name(const std::vector < std::string > &patterns,
+    const std::string & name, std::string & match)
+{
+    size_t slash = name.rfind('/');
+    std::string base(slash != std::string::npos ? name.substr(slash + 1) :
+        name);
+
+    for (size_t i = 0; i < patterns.size(); i++)
+    {
+        if (fnmatch(patterns[i].c_str(), name.c_str(), 0) == 0 ||
+            fnmatch(patterns[i].c_str(), base.c_str(), 0) == 0)
+        {
+            match = patterns[i];
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// decide whether a needed object is searched for and followed, dropped
+// with everything only it needs, or shown as the node of the fold
+// pattern it matches, which is returned in fold. Exclusion wins over
+// folding, which wins over inclusion.
+static Filter filter_name(const Options & opts, const std::string & name,
+    std::string & fold)
+{
+    std::string match;
+
+    if (match_name(opts.exclude, name, match))
+    {
+        return FILTER_DROP;
+    }
+
+    if (match_name(opts.fold, name, fold))
+    {
+        return FILTER_FOLD;
+    }
+
+    if (!opts.include.empty() && !match_name(opts.include, name, match))
+    {
+        return FILTER_DROP;
+    }
+
+    return FILTER_FOLLOW;
+}
+
+// look up an output format by name
+bool parse_format(const std::string & name, Format & format)
+{
+    if (name == "dot")
+    {
+        format = FORMAT_DOT;
+    }
+    else if (name == "binary")
+    {
+        format = FORMAT_BINARY;
+    }
+    else if (name == "json")
+    {
+        format = FORMAT_JSON;
+    }
+    else if (name == "tsv")
+    {
+        format = FORMAT_TSV;
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+// read an ELF file, through the object cache if there is one
+static bool read_object(const Options & opts, const std::string & path,
+    ElfObject & elf)
+{
+    if (opts.image != NULL)
+    {
+        return opts.image->readObject(path, elf);
+    }
+
+    return opts.cache != NULL ? opts.cache->read(path, elf) : elf.read(path);
+}
+
+// are objects looked up in an image of another system, not the host's
+static bool in_image(const Options & opts)
+{
+    return !opts.sysroot.empty() || opts.image != NULL;
+}
+
+// HostLinks reads the symbolic links of an image unpacked on the host
+class HostLinks:public LinkSource
+{
+ private:
+    const std::string & root;
+
+ public:
+    HostLinks(const std::string & r):root(r)
+    {
+    };
+
+    bool readLink(const std::string & path, std::string & target) const
+    {
+        std::string file(root + path);
+        struct stat st;
+        char buf[PATH_MAX];
+        ssize_t n;
+
+        if (lstat(file.c_str(), &st) != 0 || !S_ISLNK(st.st_mode) ||
+            (n = readlink(file.c_str(), buf, sizeof(buf) - 1)) < 0)
+        {
+            return false;
+        }
+
+        target.assign(buf, n);
+
+        return true;
+    };
+};
+
+// the host path of a path inside an image rooted at root, or the path
+// itself for no root
+static std::string sysroot_path(const std::string & root,
+    const std::string & path)
+{
+    if (root.empty())
+    {
+        return path;
+    }
+
+    return root + resolve_links(HostLinks(root), path);
+}
+
+// the path inside the --sysroot image of a file given on the command
+// line, which may be a host path under the image root
+static std::string image_path(const Options & opts, const std::string & path)
+{
+    char real[PATH_MAX];
+
+    if (opts.sysroot.empty() || realpath(path.c_str(), real) == NULL)
+    {
+        return path;
+    }
+
+    std::string r(real);
+
+    if (r.compare(0, opts.sysroot.size(), opts.sysroot) == 0 &&
+        r.size() > opts.sysroot.size() && r[opts.sysroot.size()] == '/')
+    {
+        return r.substr(opts.sysroot.size());
+    }
+
+    return path;
+}
+
+// the host path an object the loader looks for is read from; archived
+// images follow their own links as they are read
+static std::string host_path(const Options & opts, const std::string & path)
+{
+    return sysroot_path(opts.sysroot, path);
+}
+
+/*************************
+ *  ELF loader
+ *************************/
+
+// split a search path list on ':' (and ';', as ld.so does)
+static void split_path_list(const std::string & s,
+    std::vector < std::string > &dirs)
+{
+    size_t start = 0;
+
+    for (size_t i = 0; i <= s.size(); i++)
+    {
+        if (i == s.size() || s[i] == ':' || s[i] == ';')
+        {
+            dirs.push_back(s.substr(start, i - start));
+            start = i + 1;
+        }
+    }
+}
+
+// the --sysroot image or archived image the ld.so configuration is read
+// from, set before any is read
+static std::string ld_so_root;
+static const ImageArchive *ld_so_image;
+
+void set_ld_so_image(const Options & opts)
+{
+    ld_so_root = opts.sysroot;
+    ld_so_image = opts.image;
+}
+
+// read an ld.so configuration file of the image
+static bool read_ld_so_file(const std::string & file, std::string & data)
+{
+    if (ld_so_image != NULL)
+    {
+        return ld_so_image->readFile(file, data);
+    }
+
+    std::ifstream in(sysroot_path(ld_so_root, file).c_str());
+    std::ostringstream s;
+
+    s << in.rdbuf();
+    data = s.str();
+
+    return !in.fail();
+}
+
+// the ld.so configuration files of the image matching a pattern
+static void glob_ld_so_files(const std::string & pattern,
+    std::vector < std::string > &files)
+{
+    if (ld_so_image != NULL)
+    {
+        ld_so_image->glob(pattern, files);
+        return;
+    }
+
+    glob_t g;
+
+    if (glob((ld_so_root + pattern).c_str(), 0, NULL, &g) == 0)
+    {
+        for (size_t i = 0; i < g.gl_pathc; i++)
+        {
+            files.push_back(g.gl_pathv[i] + ld_so_root.size());
+        }
+    }
+
+    globfree(&g);
+}
+
+// read the directories configured in an ld.so.conf file and its includes
+static void read_ld_so_conf(const std::string & conf,
+    std::vector < std::string > &dirs)
+{
+    std::string data;
+
+    if (!read_ld_so_file(conf, data))
+    {
+        return;
+    }
+
+    std::istringstream conf_is(data);
+    std::string line;
+
+    while (std::getline(conf_is, line))
+    {
+        std::istringstream line_is(line.substr(0, line.find('#')));
+        std::string fi;
+
+        while (line_is >> fi)
+        {
+            if (fi == "include")
+            {
+                if (!(line_is >> fi))
+                {
+                    break;
+                }
+
+                // relative includes are relative to the including file
+                if (fi[0] != '/')
+                {
+                    fi = conf.substr(0, conf.rfind('/') + 1) + fi;
+                }
+
+                std::vector < std::string > files;
+
+                glob_ld_so_files(fi, files);
+
+                for (size_t i = 0; i < files.size(); i++)
+                {
+                    read_ld_so_conf(files[i], dirs);
+                }
+            }
+            else if (fi == "hwcap")
+            {
+                break;
+            }
+            else if (fi[0] == '/')
+            {
+                dirs.push_back(trim_end(fi, "/"));
+            }
+        }
+    }
+}
+
+static std::vector < std::string > ld_so_conf;
+static pthread_once_t ld_so_conf_once = PTHREAD_ONCE_INIT;
+
+static void init_ld_so_conf(void)
+{
+    read_ld_so_conf("/etc/ld.so.conf", ld_so_conf);
+}
+
+// the ld.so.conf directories, read once per process
+static const std::vector < std::string > &ld_so_conf_dirs(void)
+{
+    pthread_once(&ld_so_conf_once, init_ld_so_conf);
+
+    return ld_so_conf;
+}
+
+// LdSoCache is the library list ldconfig writes to /etc/ld.so.cache, the
+// one ld.so consults for names not found in the DT_RPATH, LD_LIBRARY_PATH
+// and DT_RUNPATH directories. Both the old format, the new format and the
+// old format followed by the new one are read. The file stays mapped,
+// and its entries are indexed by soname in their order in the file.
+class LdSoCache
+{
+ private:
+    struct Entry
+    {
+        int flags;              // type and ABI of the library
+        uint64_t hwcap;         // hardware capabilities needed, 0 for none
+        const char *path;
+    };
+
+    const unsigned char *map;
+    size_t size;
+    bool swap;                  // new format written in the other byte order
+    std::map < std::string, std::vector < Entry > >index;
+
+    // the library type, and the ABI bits of a flags field
+    enum
+    {
+        FLAG_TYPE_MASK = 0x00ff, FLAG_ELF_LIBC6 = 0x0003,
+        FLAG_REQUIRED_MASK = 0xff00
+    };
+
+    uint32_t get32(size_t off)
+    {
+        uint32_t v;
+
+        memcpy(&v, map + off, sizeof(v));
+
+        if (swap)
+        {
+            v = (v >> 24) | ((v >> 8) & 0xff00) | ((v << 8) & 0xff0000) |
+                (v << 24);
+        }
+
+        return v;
+    };
+
+    uint64_t get64(size_t off)
+    {
+        uint64_t v;
+
+        memcpy(&v, map + off, sizeof(v));
+
+        if (swap)
+        {
+            v = (uint64_t) get32(off) << 32 | get32(off + 4);
+        }
+
+        return v;
+    };
+
+    // the NUL terminated string at an offset, or NULL
+    const char *string_at(size_t off)
+    {
+        if (off >= size || memchr(map + off, '\0', size - off) == NULL)
+        {
+            return NULL;
+        }
+
+        return (const char *)map + off;
+    };
+
+    // index count entries of entry_size bytes at off, with strings at
+    // offsets from strings
+    bool add_entries(size_t off, uint32_t count, size_t entry_size,
+        size_t strings, bool is_new)
+    {
+        if (count > (size - off) / entry_size)
+        {
+            return false;
+        }
+
+        for (uint32_t i = 0; i < count; i++, off += entry_size)
+        {
+            const char *key = string_at(strings + get32(off + 4));
+            const char *value = string_at(strings + get32(off + 8));
+
+            if (key == NULL || value == NULL)
+            {
+                return false;
+            }
+
+            Entry e;
+
+            e.flags = get32(off);
+            e.hwcap = is_new ? get64(off + 16) : 0;
+            e.path = value;
+            index[key].push_back(e);
+        }
+
+        return true;
+    };
+
+    bool parse(void)
+    {
+        static const char old_magic[] = "ld.so-1.7.0";
+        static const char new_magic[] = "glibc-ld.so.cache1.1";
+        const size_t old_header = 16, old_entry = 12;
+        const size_t new_header = 48, new_entry = 24;
+        size_t off = 0;
+
+        if (size >= old_header && memcmp(map, old_magic,
+                sizeof(old_magic) - 1) == 0)
+        {
+            uint32_t count = get32(12);
+
+            if (count > (size - old_header) / old_entry)
+            {
+                return false;
+            }
+
+            // the new format follows, 8 byte aligned, in newer files
+            off = (old_header + count * old_entry + 7) & ~(size_t) 7;
+
+            if (size < off + new_header ||
+                memcmp(map + off, new_magic, sizeof(new_magic) - 1) != 0)
+            {
+                return add_entries(old_header, count, old_entry,
+                    old_header + count * old_entry, false);
+            }
+        }
+
+        if (size < off + new_header ||
+            memcmp(map + off, new_magic, sizeof(new_magic) - 1) != 0)
+        {
+            return false;
+        }
+
+        // the byte order is in the low two bits of the flags byte:
+        // 2 for little endian, 3 for big endian, 0 for unrecorded
+        unsigned int order = map[off + 28] & 3;
+        uint16_t probe = 1;
+        bool little = *(unsigned char *)&probe == 1;
+
+        swap = (order == 2 && !little) || (order == 3 && little);
+
+        return add_entries(off + new_header, get32(off + 20), new_entry, off,
+            true);
+    };
+
+    // whether an entry's flags are those ld.so accepts for an object
+    static bool flags_match(int flags, const ElfObject & elf)
+    {
+        int required = flags & FLAG_REQUIRED_MASK;
+
+        if ((flags & FLAG_TYPE_MASK) != FLAG_ELF_LIBC6)
+        {
+            return false;
+        }
+
+        // ABIs told apart by e_flags accept any of their variants
+        switch (elf.machine)
+        {
+            case EM_X86_64:
+                return required == (elf.is64 ? 0x0300 : 0x0800);
+            case EM_AARCH64:
+                return required == 0x0a00;
+            case EM_PPC64:
+                return required == 0x0500;
+            case EM_S390:
+                return required == (elf.is64 ? 0x0400 : 0);
+            case EM_SPARC:
+            case EM_SPARCV9:
+                return required == (elf.is64 ? 0x0100 : 0);
+            case EM_MIPS:
+                return elf.is64 ? required == 0x0700 || required == 0x0e00 :
+                    required == 0 || required == 0x0600 ||
+                    required == 0x0c00 || required == 0x0d00;
+            case EM_ARM:
+                return required == 0 || required == 0x0900 ||
+                    required == 0x0b00;
+#ifdef EM_RISCV
+            case EM_RISCV:
+                return required == 0x0f00 || required == 0x1000;
+#endif
+#ifdef EM_LOONGARCH
+            case EM_LOONGARCH:
+                return required == 0x1100 || required == 0x1200;
+#endif
+            default:
+                return required == 0;
+        }
+    };
+
+ public:
+    LdSoCache()
+    {
+        map = NULL;
+        size = 0;
+        swap = false;
+    };
+
+    // map and index a cache file, false if there is none or it is corrupt
+    bool load(const std::string & file)
+    {
+        int fd = ::open(file.c_str(), O_RDONLY);
+
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        struct stat st;
+
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+        {
+            void *m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (m != MAP_FAILED)
+            {
+                map = (const unsigned char *)m;
+                size = st.st_size;
+            }
+        }
+
+        ::close(fd);
+
+        if (map != NULL && !parse())
+        {
+            std::cerr << file << ": unrecognized cache format" << std::endl;
+            index.clear();
+            munmap((void *)map, size);
+            map = NULL;
+            size = 0;
+        }
+
+        return map != NULL;
+    };
+
+    // index a cache file held in memory, which must outlive the cache
+    bool attach(const std::string & file, const std::string & data)
+    {
+        map = (const unsigned char *)data.data();
+        size = data.size();
+
+        if (size == 0 || !parse())
+        {
+            if (size > 0)
+            {
+                std::cerr << file << ": unrecognized cache format" <<
+                    std::endl;
+            }
+
+            index.clear();
+            map = NULL;
+            size = 0;
+        }
+
+        return map != NULL;
+    };
+
+    bool loaded(void) const
+    {
+        return map != NULL;
+    };
+
+    // the path ld.so takes from the cache for a needed name, or ""
+    std::string lookup(const std::string & name, const ElfObject & elf) const
+    {
+        std::map < std::string, std::vector < Entry > >::const_iterator pi =
+            index.find(name);
+
+        if (pi == index.end())
+        {
+            return "";
+        }
+
+        // entries needing hardware capabilities, including those of the
+        // glibc-hwcaps subdirectories, depend on the CPU; the baseline
+        // library is the one every CPU loads
+        for (size_t i = 0; i < pi->second.size(); i++)
+        {
+            const Entry & e = pi->second[i];
+
+            if (e.hwcap == 0 && flags_match(e.flags, elf))
+            {
+                return e.path;
+            }
+        }
+
+        return "";
+    };
+};
+
+static LdSoCache ld_so_cache_file;
+static std::string ld_so_cache_data;    // an archived image's cache file
+static pthread_once_t ld_so_cache_once = PTHREAD_ONCE_INIT;
+
+static void init_ld_so_cache(void)
+{
+    if (ld_so_image == NULL)
+    {
+        ld_so_cache_file.load(sysroot_path(ld_so_root, "/etc/ld.so.cache"));
+    }
+    else if (ld_so_image->readFile("/etc/ld.so.cache", ld_so_cache_data))
+    {
+        ld_so_cache_file.attach("/etc/ld.so.cache", ld_so_cache_data);
+    }
+}
+
+// the ld.so.cache, read once per process
+static const LdSoCache & ld_so_cache(void)
+{
+    pthread_once(&ld_so_cache_once, init_ld_so_cache);
+
+    return ld_so_cache_file;
+}
+
+// substitute the $ORIGIN and $LIB dynamic string tokens in a search path
+// of the object at path
+static std::string expand_tokens(const std::string & s,
+    const std::string & path, bool is64)
+{
+    std::string origin(path.substr(0, path.rfind('/')));
+    std::string lib(is64 ? "lib64" : "lib");
+    std::string out;
+
+    if (path.find('/') == std::string::npos)
+    {
+        origin = ".";
+    }
+
+    for (size_t i = 0; i < s.size(); i++)
+    {
+        std::string rest(s.substr(i));
+
+        if (rest.compare(0, 9, "${ORIGIN}") == 0)
+        {
+            out += origin;
+            i += 8;
+        }
+        else if (rest.compare(0, 7, "$ORIGIN") == 0)
+        {
+            out += origin;
+            i += 6;
+        }
+        else if (rest.compare(0, 6, "${LIB}") == 0)
+        {
+            out += lib;
+            i += 5;
+        }
+        else if (rest.compare(0, 4, "$LIB") == 0)
+        {
+            out += lib;
+            i += 3;
+        }
+        else
+        {
+            out += s[i];
+        }
+    }
+
+    return out;
+}
+
+// the built in default directories for an ELF class
+static std::vector < std::string > default_dirs(bool is64)
+{
+    std::vector < std::string > dirs;
+
+    if (is64)
+    {
+        dirs.push_back("/lib64");
+        dirs.push_back("/usr/lib64");
+    }
+
+    dirs.push_back("/lib");
+    dirs.push_back("/usr/lib");
+
+    return dirs;
+}
+
+// Prefetch reads the objects a root is likely to load ahead of the
+// loader, on a pool of threads. Each object read is searched for its
+// DT_NEEDED entries, breadth first from the root, and the objects found
+// are queued to be read in turn. The search only looks at the needing
+// object's own DT_RPATH, so the loader still makes every decision, and
+// reads anything the prefetch missed itself; reads of the same file are
+// shared through the visited set, whichever thread asks first.
+class Prefetch
+{
+ private:
+    struct Entry
+    {
+        bool done;              // read is complete
+        bool ok;                // read succeeded
+        bool queued;            // its needed entries are being searched
+        unsigned int depth;     // needs from the root, once queued
+        ElfObject elf;
+    };
+
+    const Options & opts;
+    ElfObject root;             // for compatibility
+    std::map < std::string, Entry * >visited;   // by path
+    std::vector < std::string > queue;  // objects to search, breadth first
+    size_t next;                // next queue entry to be claimed
+    unsigned int busy;          // threads searching an object
+    bool stopping;              // the loader is done
+    std::vector < pthread_t > tids;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;     // a read completed or work was queued
+
+    // the entry for a file, read by this thread unless another thread
+    // already read it or is reading it; called with the lock held
+    Entry *fetch_locked(const std::string & file)
+    {
+        Entry *&entry = visited[file];
+
+        if (entry == NULL)
+        {
+            entry = new Entry;
+            entry->done = false;
+            entry->queued = false;
+
+            // read without the lock, others wait for this entry alone
+            Entry *e = entry;
+
+            pthread_mutex_unlock(&lock);
+            e->ok = read_object(opts, host_path(opts, file), e->elf) &&
+                e->elf.compatible(root);
+            pthread_mutex_lock(&lock);
+            e->done = true;
+            pthread_cond_broadcast(&changed);
+
+            return e;
+        }
+
+        Entry *e = entry;
+
+        while (!e->done)
+        {
+            pthread_cond_wait(&changed, &lock);
+        }
+
+        return e;
+    };
+
+    void enqueue_locked(const std::string & file, Entry * entry,
+        unsigned int depth)
+    {
+        if (!entry->queued)
+        {
+            entry->queued = true;
+            entry->depth = depth;
+            queue.push_back(file);
+            pthread_cond_broadcast(&changed);
+        }
+    };
+
+    // find and read the objects an object needs, as the loader's filters
+    // allow; called with the lock held
+    void search(const std::string & file, const ElfObject & elf,
+        unsigned int depth)
+    {
+        std::vector < std::string > dirs;
+
+        if (opts.max_depth >= 0 && depth >= (unsigned int)opts.max_depth)
+        {
+            return;
+        }
+
+        if (!elf.has_runpath && !elf.rpath.empty())
+        {
+            split_path_list(elf.rpath, dirs);
+        }
+
+        // the host's LD_LIBRARY_PATH means nothing inside an image
+        const char *env = getenv("LD_LIBRARY_PATH");
+
+        if (env != NULL && *env != '\0' && !in_image(opts))
+        {
+            split_path_list(env, dirs);
+        }
+
+        if (!elf.runpath.empty())
+        {
+            split_path_list(elf.runpath, dirs);
+        }
+
+        const LdSoCache & cache = ld_so_cache();
+        std::vector < std::string > defaults(default_dirs(elf.is64));
+
+        if (!cache.loaded())
+        {
+            const std::vector < std::string > &conf = ld_so_conf_dirs();
+
+            dirs.insert(dirs.end(), conf.begin(), conf.end());
+        }
+
+        for (size_t i = 0; i < elf.needed.size() && !stopping; i++)
+        {
+            const std::string & name = elf.needed[i];
+            std::vector < std::string > candidates;
+            std::string fold;
+
+            if (filter_name(opts, name, fold) != FILTER_FOLLOW)
+            {
+                continue;
+            }
+
+            if (name.find('/') != std::string::npos)
+            {
+                candidates.push_back(expand_tokens(name, file, elf.is64));
+            }
+            else
+            {
+                for (size_t j = 0; j < dirs.size(); j++)
+                {
+                    std::string dir(expand_tokens(dirs[j], file, elf.is64));
+
+                    candidates.push_back(dir.empty() ? name : dir + "/" + name);
+                }
+
+                std::string cached(cache.lookup(name, root));
+
+                if (!cached.empty())
+                {
+                    candidates.push_back(cached);
+                }
+
+                for (size_t j = 0; j < defaults.size(); j++)
+                {
+                    candidates.push_back(defaults[j] + "/" + name);
+                }
+            }
+
+            for (size_t j = 0; j < candidates.size() && !stopping; j++)
+            {
+                Entry *entry = fetch_locked(candidates[j]);
+
+                if (entry->ok)
+                {
+                    enqueue_locked(candidates[j], entry, depth + 1);
+                    break;
+                }
+            }
+        }
+    };
+
+    static void *worker(void *arg)
+    {
+        Prefetch *pf = (Prefetch *) arg;
+
+        pthread_mutex_lock(&pf->lock);
+
+        for (;;)
+        {
+            while (!pf->stopping && pf->next == pf->queue.size() &&
+                pf->busy > 0)
+            {
+                pthread_cond_wait(&pf->changed, &pf->lock);
+            }
+
+            // done when stopped, or when nothing is queued or being
+            // searched that could queue more
+            if (pf->stopping || pf->next == pf->queue.size())
+            {
+                break;
+            }
+
+            std::string file(pf->queue[pf->next++]);
+            Entry *entry = pf->visited[file];
+
+            pf->busy++;
+            pf->search(file, entry->elf, entry->depth);
+            pf->busy--;
+            pthread_cond_broadcast(&pf->changed);
+        }
+
+        pthread_mutex_unlock(&pf->lock);
+
+        return NULL;
+    };
+
+ public:
+    Prefetch(const Options & o):opts(o)
+    {
+        next = 0;
+        busy = 0;
+        stopping = false;
+        pthread_mutex_init(&lock, NULL);
+        pthread_cond_init(&changed, NULL);
+    };
+
+    ~Prefetch()
+    {
+        stop();
+
+        for (std::map < std::string, Entry * >::iterator pe = visited.begin();
+            pe != visited.end(); ++pe)
+        {
+            delete pe->second;
+        }
+
+        pthread_cond_destroy(&changed);
+        pthread_mutex_destroy(&lock);
+    };
+
+    // start reading the objects needed by the root on threads threads
+    void start(const std::string & file, const ElfObject & elf,
+        unsigned int threads)
+    {
+        pthread_mutex_lock(&lock);
+
+        Entry *entry = new Entry;
+
+        root = elf;
+        entry->done = true;
+        entry->ok = true;
+        entry->queued = false;
+        entry->elf = elf;
+        visited[file] = entry;
+        enqueue_locked(file, entry, 0);
+        pthread_mutex_unlock(&lock);
+
+        for (unsigned int t = 0; t < threads; t++)
+        {
+            pthread_t tid;
+
+            if (pthread_create(&tid, NULL, worker, this) == 0)
+            {
+                tids.push_back(tid);
+            }
+        }
+    };
+
+    // read a file, sharing the read with the prefetch threads
+    bool read(const std::string & file, ElfObject & elf)
+    {
+        if (tids.empty())
+        {
+            return read_object(opts, host_path(opts, file), elf);
+        }
+
+        pthread_mutex_lock(&lock);
+
+        Entry *entry = fetch_locked(file);
+        bool ok = entry->ok;
+
+        if (ok)
+        {
+            elf = entry->elf;
+        }
+
+        pthread_mutex_unlock(&lock);
+
+        return ok;
+    };
+
+    // stop the prefetch threads, abandoning any queued work
+    void stop(void)
+    {
+        pthread_mutex_lock(&lock);
+        stopping = true;
+        pthread_cond_broadcast(&changed);
+        pthread_mutex_unlock(&lock);
+
+        for (size_t t = 0; t < tids.size(); t++)
+        {
+            pthread_join(tids[t], NULL);
+        }
+
+        tids.clear();
+    };
+};
+
+// ElfLoader follows the ld.so search rules from a root ELF file, adding
+// a node for every object that would be loaded and an edge for every
+// DT_NEEDED entry, labeled with the DT_VERNEED versions required of it.
+class ElfLoader
+{
+ private:
+    // an object in load order
+    struct Loaded
+    {
+        std::string path;       // path it was found at
+        std::string file;       // host path it was read from
+        ElfObject elf;
+        Node *node;
+        Loaded *loader;         // object that needed it, NULL for root
+        unsigned int depth;     // needs from the root
+        std::map < std::string, Loaded * >deps; // needed name to object
+        std::map < std::string, Node * >folded; // needed name to fold node
+    };
+
+    std::string path;           // root file pathname
+    const Options & opts;
+    Node *root_node;
+    std::vector < Loaded * >objs;       // objects in load order
+    std::map < std::string, Loaded * >names;    // loaded names, sonames
+    std::map < std::string, Node * >missing;    // unfound needed names
+    Node *not_found_node;       // virtual node for unfound objects
+    std::map < std::string, Node * >folds;      // by fold pattern
+    std::map < std::pair < Node *, Node * >, Edge * >edge_index;
+    Prefetch prefetch;          // reads objects ahead of the search
+    Stats *stats;               // counts, or NULL
+
+    Edge *get_edge(Edges & edges, Node * from, Node * to)
+    {
+        Edge *&edge = edge_index[std::make_pair(from, to)];
+
+        if (edge == NULL)
+        {
+            edge = edges.add(from, to);
+        }
+
+        return edge;
+    };
+
+    Loaded *new_loaded(const std::string & file, Loaded * loader)
+    {
+        Loaded *obj = new Loaded;
+
+        obj->path = file;
+        obj->file = host_path(opts, file);
+        obj->loader = loader;
+        obj->depth = loader == NULL ? 0 : loader->depth + 1;
+        obj->node = loader == NULL ? root_node : NULL;
+
+        return obj;
+    };
+
+    void add_loaded(Nodes & nodes, Loaded * obj)
+    {
+        if (obj->loader != NULL)
+        {
+            nodes.push_back(obj->node);
+        }
+
+        objs.push_back(obj);
+    };
+
+    void add_name(const std::string & name, Loaded * obj)
+    {
+        if (!name.empty() && names.find(name) == names.end())
+        {
+            names[name] = obj;
+        }
+    };
+
+    std::string expand(const std::string & s, Loaded * obj)
+    {
+        return expand_tokens(s, obj->path, obj->elf.is64);
+    };
+
+    // try to load a candidate file for the needed name
+    Loaded *try_path(Nodes & nodes, Loaded * loader, const std::string & file)
+    {
+        std::map < std::string, Loaded * >::iterator pl = names.find(file);
+
+        if (pl != names.end())
+        {
+            return pl->second;
+        }
+
+        Loaded *obj = new_loaded(file, loader);
+
+        if (stats != NULL)
+        {
+            stats->lookups++;
+        }
+
+        if (!prefetch.read(file, obj->elf) ||
+            !obj->elf.compatible(objs[0]->elf))
+        {
+            DEBUG_OUT(std::cerr << file << ": not loadable" << std::endl);
+            delete obj;
+            return NULL;
+        }
+
+        obj->node = nodes.create(trim_front(file, "./"));
+        add_loaded(nodes, obj);
+        add_name(file, obj);
+
+        return obj;
+    };
+
+    Loaded *search_dirs(Nodes & nodes, Loaded * loader,
+        const std::vector < std::string > &dirs, const std::string & name)
+    {
+        for (std::vector < std::string >::const_iterator pd = dirs.begin();
+            pd != dirs.end(); ++pd)
+        {
+            std::string dir(expand(*pd, loader));
+            Loaded *obj = try_path(nodes, loader,
+                dir.empty() ? name : dir + "/" + name);
+
+            if (obj != NULL)
+            {
+                return obj;
+            }
+        }
+
+        return NULL;
+    };
+
+    // locate a needed name the way ld.so does
+    Loaded *find_needed(Nodes & nodes, Loaded * loader, const std::string & name)
+    {
+        std::map < std::string, Loaded * >::iterator pl = names.find(name);
+
+        if (pl != names.end())
+        {
+            return pl->second;
+        }
+
+        Loaded *obj = NULL;
+
+        if (name.find('/') != std::string::npos)
+        {
+            obj = try_path(nodes, loader, expand(name, loader));
+        }
+        else
+        {
+            std::vector < std::string > dirs;
+
+            // DT_RPATH of the loader chain, unless DT_RUNPATH is present
+            if (!loader->elf.has_runpath)
+            {
+                for (Loaded * pl = loader; pl != NULL; pl = pl->loader)
+                {
+                    if (!pl->elf.has_runpath && !pl->elf.rpath.empty())
+                    {
+                        split_path_list(pl->elf.rpath, dirs);
+                    }
+                }
+            }
+
+            const char *env = getenv("LD_LIBRARY_PATH");
+
+            if (env != NULL && *env != '\0' && !in_image(opts))
+            {
+                split_path_list(env, dirs);
+            }
+
+            if (!loader->elf.runpath.empty())
+            {
+                split_path_list(loader->elf.runpath, dirs);
+            }
+
+            obj = search_dirs(nodes, loader, dirs, name);
+
+            // the ld.so.cache, or without one the directories it lists
+            const LdSoCache & cache = ld_so_cache();
+
+            if (obj == NULL && cache.loaded())
+            {
+                std::string file(cache.lookup(name, objs[0]->elf));
+
+                if (!file.empty())
+                {
+                    obj = try_path(nodes, loader, file);
+                }
+            }
+            else if (obj == NULL)
+            {
+                obj = search_dirs(nodes, loader, ld_so_conf_dirs(), name);
+            }
+
+            if (obj == NULL)
+            {
+                obj = search_dirs(nodes, loader,
+                    default_dirs(objs[0]->elf.is64), name);
+            }
+        }
+
+        if (obj != NULL)
+        {
+            add_name(name, obj);
+        }
+
+        return obj;
+    };
+
+    // the node standing for every object matching a fold pattern
+    Node *fold_node(Nodes & nodes, const std::string & pattern)
+    {
+        Node *&node = folds[pattern];
+
+        if (node == NULL)
+        {
+            node = nodes.add(pattern);
+        }
+
+        return node;
+    };
+
+    void load_needed(Nodes & nodes, Edges & edges, Loaded * obj)
+    {
+        // objects at the depth limit are listed, but their needs are not
+        // searched for
+        if (opts.max_depth >= 0 && obj->depth >= (unsigned int)opts.max_depth)
+        {
+            return;
+        }
+
+        for (std::vector < std::string >::iterator pn = obj->elf.needed.begin();
+            pn != obj->elf.needed.end(); ++pn)
+        {
+            std::string fold;
+            Filter filter = filter_name(opts, *pn, fold);
+
+            if (filter == FILTER_DROP)
+            {
+                continue;
+            }
+
+            if (filter == FILTER_FOLD)
+            {
+                obj->folded[*pn] = fold_node(nodes, fold);
+                get_edge(edges, obj->node, obj->folded[*pn]);
+                continue;
+            }
+
+            Loaded *dep = find_needed(nodes, obj, *pn);
+
+            if (dep != NULL)
+            {
+                obj->deps[*pn] = dep;
+                get_edge(edges, obj->node, dep->node);
+                continue;
+            }
+
+            std::cerr << *pn << ": shared object not found, required by " <<
+                obj->path << std::endl;
+
+            Node *&sub_node = missing[*pn];
+
+            if (sub_node == NULL)
+            {
+                sub_node = nodes.add(*pn);
+            }
+
+            if (not_found_node == NULL)
+            {
+                not_found_node = nodes.add("not found");
+            }
+
+            get_edge(edges, obj->node, sub_node);
+            get_edge(edges, sub_node, not_found_node);
+        }
+    };
+
+    // bind the undefined symbols of each object to the first object in
+    // load order defining them, as ld.so does for the global scope, and
+    // count the symbols bound across each DT_NEEDED edge
+    void bind_symbols(std::vector < ElfSymbols * >&syms)
+    {
+        // bound symbols by the indexes of the objects needing and defining
+        std::map < std::pair < size_t, size_t >, unsigned int >counts;
+        std::map < std::pair < size_t, size_t >,
+            std::vector < unsigned int > >names;
+
+        for (size_t i = 0; i < objs.size(); i++)
+        {
+            std::vector < const char *>undefined;
+
+            syms[i]->undefined(undefined);
+
+            for (size_t u = 0; u < undefined.size(); u++)
+            {
+                for (size_t j = 0; j < objs.size(); j++)
+                {
+                    if (j != i && syms[j]->defines(undefined[u]))
+                    {
+                        counts[std::make_pair(i, j)]++;
+
+                        if (opts.symbols > 1)
+                        {
+                            names[std::make_pair(i, j)].
+                                push_back(strings.intern(undefined[u]));
+                        }
+                        break;
+                    }
+                }
+            }
+        }
+
+        std::map < Loaded *, size_t > index;
+
+        for (size_t i = 0; i < objs.size(); i++)
+        {
+            index[objs[i]] = i;
+        }
+
+        for (size_t i = 0; i < objs.size(); i++)
+        {
+            for (std::map < std::string, Loaded * >::iterator pd =
+                objs[i]->deps.begin(); pd != objs[i]->deps.end(); ++pd)
+            {
+                std::pair < size_t, size_t > key(i, index[pd->second]);
+                std::map < std::pair < Node *, Node * >, Edge * >::iterator pe =
+                    edge_index.find(std::make_pair(objs[i]->node,
+                        pd->second->node));
+
+                if (pe != edge_index.end())
+                {
+                    pe->second->setSymbols(counts[key], names[key]);
+                }
+            }
+        }
+    };
+
+    // read the symbol tables and relocations of the loaded objects for
+    // symbol binding and load costs
+    void analyze(void)
+    {
+        std::vector < ElfSymbols * >syms(objs.size());
+
+        for (size_t i = 0; i < objs.size(); i++)
+        {
+            syms[i] = new ElfSymbols;
+
+            if (!syms[i]->open(objs[i]->file))
+            {
+                DEBUG_OUT(std::cerr << objs[i]->path << ": no symbols" <<
+                    std::endl);
+            }
+
+            if (opts.cost > 0)
+            {
+                LoadCost c;
+
+                syms[i]->cost(c);
+                objs[i]->node->setCost(c);
+            }
+        }
+
+        if (opts.symbols > 0)
+        {
+            bind_symbols(syms);
+        }
+
+        for (size_t i = 0; i < syms.size(); i++)
+        {
+            delete syms[i];
+        }
+    };
+
+    void label_versions(Edges & edges, Loaded * obj)
+    {
+        // as in load_needed, objects at the depth limit get no edges
+        if (opts.max_depth >= 0 && obj->depth >= (unsigned int)opts.max_depth)
+        {
+            return;
+        }
+
+        for (std::vector < ElfVerneed >::iterator pv = obj->elf.verneed.begin();
+            pv != obj->elf.verneed.end(); ++pv)
+        {
+            std::map < std::string, Loaded * >::iterator pd =
+                obj->deps.find(pv->file);
+            std::map < std::string, Node * >::iterator pf =
+                obj->folded.find(pv->file);
+            Loaded *dep = pd != obj->deps.end() ? pd->second : NULL;
+
+            if (dep == NULL && pf == obj->folded.end())
+            {
+                std::map < std::string, Loaded * >::iterator pl =
+                    names.find(pv->file);
+                std::string fold;
+
+                if (pl == names.end() ||
+                    filter_name(opts, pv->file, fold) != FILTER_FOLLOW)
+                {
+                    continue;
+                }
+
+                dep = pl->second;
+            }
+
+            // folded objects were never read to check their versions
+            Edge *edge = get_edge(edges, obj->node, dep != NULL ? dep->node :
+                pf->second);
+
+            for (std::vector < std::string >::iterator ps =
+                pv->versions.begin(); ps != pv->versions.end(); ++ps)
+            {
+                if (dep != NULL && !dep->elf.defines_version(*ps))
+                {
+                    std::cerr << path << ": " << dep->path << ": version `" <<
+                        *ps << "' not found (required by " << obj->path <<
+                        ")" << std::endl;
+                }
+
+                edge->addLabel(*ps);
+            }
+        }
+    };
+
+ public:
+    ElfLoader(std::string p, Node * root, const Options & o):opts(o),
+        prefetch(o)
+    {
+        path = p;
+        root_node = root;
+        not_found_node = NULL;
+        stats = NULL;
+    };
+
+    void setStats(Stats * s)
+    {
+        stats = s;
+    };
+
+    ~ElfLoader()
+    {
+        for (std::vector < Loaded * >::iterator po = objs.begin();
+            po != objs.end(); ++po)
+        {
+            delete *po;
+        }
+    };
+
+    void load(Nodes & nodes, Edges & edges)
+    {
+        // with --sysroot the root may lie outside the image, but it is
+        // named and searched from by its path inside it
+        Loaded *root = new_loaded(image_path(opts, path), NULL);
+
+        root->file = path;
+
+        // owned by the loader from here on, even if it is unusable
+        add_loaded(nodes, root);
+
+        if (!read_object(opts, root->file, root->elf))
+        {
+            throw InputError(path, "cannot read ELF file");
+        }
+
+        if (!root->elf.dynamic)
+        {
+            throw InputError(path, "not a dynamically loaded file");
+        }
+
+        add_name(root->path, root);
+
+        if (opts.load_threads > 1)
+        {
+            prefetch.start(root->path, root->elf, opts.load_threads);
+        }
+
+        // the program interpreter is loaded up front so needed references
+        // to it resolve by soname, but like ldd it is listed last
+        Loaded *interp = NULL;
+        std::string interp_path(root->elf.interp);
+
+        // shared objects have no interpreter of their own, and ldd runs
+        // them under the system loader, which is the one we run under
+        // unless the image is another system
+        if (interp_path.empty() && !root->elf.needed.empty() &&
+            !in_image(opts))
+        {
+            ElfObject self;
+
+            if (self.read("/proc/self/exe") && self.compatible(root->elf))
+            {
+                interp_path = self.interp;
+            }
+        }
+
+        // the interpreter is filtered as a needed object of the root
+        std::string interp_fold;
+        Filter interp_filter = interp_path.empty() || opts.max_depth == 0 ?
+            FILTER_DROP : filter_name(opts, interp_path, interp_fold);
+
+        if (interp_filter != FILTER_FOLLOW)
+        {
+            interp_path.clear();
+        }
+
+        if (!interp_path.empty())
+        {
+            interp = new_loaded(interp_path, root);
+
+            if (read_object(opts, interp->file, interp->elf))
+            {
+                interp->node = nodes.create(trim_front(interp->path, "./"));
+                add_name(interp->path, interp);
+                add_name(interp->elf.soname, interp);
+            }
+            else
+            {
+                std::cerr << interp->path << ": cannot read interpreter" <<
+                    std::endl;
+                delete interp;
+                interp = NULL;
+            }
+        }
+
+        // breadth first, as ld.so maps dependencies
+        for (size_t i = 0; i < objs.size(); i++)
+        {
+            Loaded *obj = objs[i];
+
+            add_name(obj->elf.soname, obj);
+            load_needed(nodes, edges, obj);
+
+            if (i + 1 == objs.size() && interp != NULL)
+            {
+                add_loaded(nodes, interp);
+                get_edge(edges, root_node, interp->node);
+                interp = NULL;
+            }
+        }
+
+        if (interp_filter == FILTER_FOLD)
+        {
+            get_edge(edges, root_node, fold_node(nodes, interp_fold));
+        }
+
+        prefetch.stop();
+
+        for (std::vector < Loaded * >::iterator po = objs.begin();
+            po != objs.end(); ++po)
+        {
+            label_versions(edges, *po);
+        }
+
+        if (opts.symbols > 0 || opts.cost > 0)
+        {
+            analyze();
+        }
+    };
+};
+
+/*************************
+ *  Child processes
+ *************************/
+
+// read what a child has written to a non-blocking pipe, true once it has
+// closed its end
+static bool drain_pipe(int fd, std::string & output)
+{
+    char buf[1 << 16];
+
+    for (;;)
+    {
+        ssize_t n = ::read(fd, buf, sizeof(buf));
+
+        if (n > 0)
+        {
+            output.append(buf, n);
+        }
+        else if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else
+        {
+            return n == 0 || errno != EAGAIN;
+        }
+    }
+}
+
+// reap a child if it has exited, without waiting for it
+static bool reap_child(pid_t pid, int & status)
+{
+    pid_t r;
+
+    while ((r = waitpid(pid, &status, WNOHANG)) < 0 && errno == EINTR)
+    {
+    }
+
+    return r != 0;
+}
+
+// kill a child and the process group it leads, and reap it
+static void kill_group(pid_t pid, int & status)
+{
+    kill(-pid, SIGKILL);
+
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+    {
+    }
+}
+
+/*************************
+ *  Profiler
+ *************************/
+
+// Profiler runs an executable under LD_DEBUG=statistics,files, much as
+// Parser runs ldd, and records the loader's own figures: the startup,
+// relocation and load times on the root node, and the order objects
+// were loaded in on the nodes and on the edges that caused each load.
+// ld.so times relocation as a whole, not per object.
+class Profiler
+{
+ private:
+    std::string path;           // executable
+    unsigned int runs;
+    double timeout;             // seconds before a run is killed, or 0
+
+    // the text after the pid prefix of an LD_DEBUG line, or false
+    static bool debug_text(const std::string & line, std::string & text)
+    {
+        size_t i = line.find_first_not_of(' ');
+
+        if (i == std::string::npos || !isdigit((unsigned char)line[i]))
+        {
+            return false;
+        }
+
+        i = line.find_first_not_of("0123456789", i);
+
+        if (i == std::string::npos || line.compare(i, 2, ":\t") != 0)
+        {
+            return false;
+        }
+
+        text = trim_end(line.substr(i + 2), "\n");
+
+        return true;
+    };
+
+    // the first number after the colon of a statistics line
+    static uint64_t figure(const std::string & text)
+    {
+        size_t colon = text.find(':');
+
+        return colon == std::string::npos ? 0 :
+            strtoull(text.c_str() + colon + 1, NULL, 10);
+    };
+
+    // the node loaded for a file= name, looked up by path, or by file
+    // name when it has no slash
+    static Node *find_node(std::map < std::string, Node * >&by_path,
+        std::map < std::string, Node * >&by_name, const std::string & file)
+    {
+        std::map < std::string, Node * >&names =
+            file.find('/') == std::string::npos ? by_name : by_path;
+        std::map < std::string, Node * >::iterator pn = names.find(file);
+
+        return pn == names.end() ? NULL : pn->second;
+    };
+
+    // start the executable in a process group of its own, so anything
+    // it starts dies with it, under LD_DEBUG and with its stdin and
+    // stdout on /dev/null; the loader writes to fd, through stderr
+    void start(pid_t & pid, int & fd)
+    {
+        std::vector < std::string > env;
+        std::vector < char * >envp;
+
+        for (char **e = environ; *e != NULL; e++)
+        {
+            if (strncmp(*e, "LD_DEBUG=", 9) != 0)
+            {
+                env.push_back(*e);
+            }
+        }
+
+        env.push_back("LD_DEBUG=statistics,files");
+
+        for (size_t i = 0; i < env.size(); i++)
+        {
+            envp.push_back(&env[i][0]);
+        }
+
+        envp.push_back(NULL);
+
+        int fds[2];
+
+        if (pipe2(fds, O_CLOEXEC) != 0)
+        {
+            throw InputError(path, std::string("pipe2: ") + strerror(errno));
+        }
+
+        posix_spawn_file_actions_t actions;
+        posix_spawnattr_t attr;
+        const char *argv[] = { path.c_str(), NULL };
+
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_adddup2(&actions, fds[1], STDERR_FILENO);
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null",
+            O_WRONLY, 0);
+        posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null",
+            O_RDONLY, 0);
+        posix_spawnattr_init(&attr);
+        posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+        posix_spawnattr_setpgroup(&attr, 0);
+
+        int err = posix_spawn(&pid, path.c_str(), &actions, &attr,
+            (char *const *)argv, &envp[0]);
+
+        posix_spawnattr_destroy(&attr);
+        posix_spawn_file_actions_destroy(&actions);
+        ::close(fds[1]);
+
+        if (err != 0)
+        {
+            ::close(fds[0]);
+            throw InputError(path, std::string("posix_spawn: ") +
+                strerror(err));
+        }
+
+        fcntl(fds[0], F_SETFL, O_NONBLOCK);
+        fd = fds[0];
+    };
+
+    // run once, returning what the loader wrote; the timeout covers the
+    // exit as well as the output, and a run still going at it is killed
+    // with its process group
+    std::string run_output(void)
+    {
+        pid_t pid;
+        int fd, status = 0;
+        std::string output;
+        double deadline = timeout > 0 ? now() + timeout : 0;
+        bool exited = false, late = false;
+
+        start(pid, fd);
+
+        while (!exited && !late)
+        {
+            double t = now();
+            int wait = deadline == 0 ? -1 : deadline <= t ? 0 :
+                (int)((deadline - t) * 1000) + 1;
+            struct pollfd pfd;
+
+            // once its output is closed, look for the exit every few
+            // milliseconds, as there is no fd to wait on
+            if (fd < 0 && (wait < 0 || wait > 10))
+            {
+                wait = 10;
+            }
+
+            pfd.fd = fd;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+
+            if (poll(&pfd, 1, wait) < 0 && errno != EINTR)
+            {
+                int err = errno;
+
+                if (fd >= 0)
+                {
+                    ::close(fd);
+                }
+
+                kill_group(pid, status);
+                throw InputError(path, std::string("poll: ") + strerror(err));
+            }
+
+            if (fd >= 0 && pfd.revents != 0 && drain_pipe(fd, output))
+            {
+                ::close(fd);
+                fd = -1;
+            }
+
+            exited = fd < 0 && reap_child(pid, status);
+            late = !exited && deadline > 0 && now() >= deadline;
+        }
+
+        if (late)
+        {
+            std::ostringstream reason;
+
+            if (fd >= 0)
+            {
+                ::close(fd);
+            }
+
+            kill_group(pid, status);
+            reason << "profiled run timed out after " << timeout <<
+                " seconds";
+            throw InputError(path, reason.str());
+        }
+
+        // the program may exit as it likes without its arguments, but a
+        // run killed by a signal is not one to time
+        if (WIFSIGNALED(status))
+        {
+            std::ostringstream reason;
+
+            reason << "profiled run killed by signal " << WTERMSIG(status);
+            throw InputError(path, reason.str());
+        }
+
+        return output;
+    };
+
+    // run once, adding the times to profile and, on the first run,
+    // recording the load order
+    void run_once(StartupProfile & profile, std::vector < std::string > &order,
+        std::vector < std::string > &needed_by)
+    {
+        std::string output(run_output());
+        bool in_stats = false, got_stats = false;
+        uint64_t startup = 0, relocation = 0, load = 0;
+        std::string text;
+
+        for (size_t pos = 0, eol; pos < output.size(); pos = eol + 1)
+        {
+            eol = output.find('\n', pos);
+
+            if (eol == std::string::npos)
+            {
+                eol = output.size();
+            }
+
+            if (!debug_text(output.substr(pos, eol - pos), text))
+            {
+                continue;
+            }
+
+            size_t start = text.find_first_not_of(" \t");
+            std::string t(start == std::string::npos ? "" : text.substr(start));
+
+            if (t.compare(0, 5, "file=") == 0 && profile.runs == 0)
+            {
+                size_t end = t.find(" [");
+                std::string file(t.substr(5, end - 5));
+                size_t by = t.find("needed by ");
+
+                if (by != std::string::npos)
+                {
+                    std::string from(t.substr(by + 10));
+
+                    needed_by.push_back(from.substr(0, from.rfind(" [")));
+                    order.push_back(file);
+                }
+            }
+            else if (t == "runtime linker statistics:")
+            {
+                in_stats = !got_stats;
+            }
+            else if (in_stats)
+            {
+                if (t.compare(0, 36, "total startup time in dynamic loader") == 0)
+                {
+                    startup = figure(t);
+                }
+                else if (t.compare(0, 26, "time needed for relocation") == 0)
+                {
+                    relocation = figure(t);
+                }
+                else if (t.compare(0, 27, "time needed to load objects") == 0)
+                {
+                    load = figure(t);
+                    in_stats = false;
+                    got_stats = true;
+                }
+                else if (t.compare(0, 30, "number of relative relocations") == 0)
+                {
+                    profile.relative = figure(t);
+                }
+                else if (t.compare(0, 22, "number of relocations:") == 0)
+                {
+                    profile.relocations = figure(t);
+                }
+            }
+        }
+
+        if (!got_stats)
+        {
+            throw InputError(path, "no loader statistics");
+        }
+
+        profile.add(startup, relocation, load);
+    };
+
+ public:
+    Profiler(const std::string & p, unsigned int n, double seconds)
+    {
+        path = p;
+        runs = n;
+        timeout = seconds;
+    };
+
+    // run the executable, failing its input if a run fails
+    void profile(Nodes & nodes, Edges & edges)
+    {
+        StartupProfile profile;
+        std::vector < std::string > order, needed_by;
+        ElfObject elf;
+
+        // shared objects without an interpreter are not run
+        if (!elf.read(path) || elf.interp.empty())
+        {
+            std::cerr << path << ": not an executable, not profiled" <<
+                std::endl;
+            return;
+        }
+
+        for (unsigned int i = 0; i < runs; i++)
+        {
+            run_once(profile, order, needed_by);
+        }
+
+        nodes[0]->setProfile(profile);
+        nodes[0]->setLoadOrder(0);
+
+        // ld.so names objects as needed, so a file= name is matched to
+        // the first node with that path or, with no slash in it, that
+        // file name
+        std::map < std::string, Node * >by_path, by_name;
+        std::map < std::pair < Node *, Node * >, Edge * >by_ends;
+
+        for (Nodes::iterator pn = nodes.begin(); pn != nodes.end(); ++pn)
+        {
+            const std::string & p = (*pn)->getPath();
+
+            by_path.insert(std::make_pair(p, *pn));
+            by_name.insert(std::make_pair(p.substr(p.rfind('/') + 1), *pn));
+        }
+
+        for (Edges::iterator pe = edges.begin(); pe != edges.end(); ++pe)
+        {
+            by_ends.insert(std::make_pair(std::make_pair((*pe)->getFrom(),
+                        (*pe)->getTo()), *pe));
+        }
+
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            Node *to = find_node(by_path, by_name, order[i]);
+            Node *from = find_node(by_path, by_name, needed_by[i]);
+
+            if (to == NULL)
+            {
+                continue;
+            }
+
+            to->setLoadOrder(i + 1);
+
+            std::map < std::pair < Node *, Node * >, Edge * >::iterator pe =
+                by_ends.find(std::make_pair(from, to));
+
+            if (pe != by_ends.end())
+            {
+                pe->second->setLoadOrder(i + 1);
+            }
+        }
+    };
+};
+
+/*************************
+ *  ldd runs
+ *************************/
+
+// LddPool runs ldd -v on inputs ahead of their parse. Children are
+// started in input order with posix_spawnp, without a shell, at most a
+// given number at once, and one thread reads the output of them all
+// through poll, killing the process group of any child still running
+// its timeout after it started. A parser takes the output of its input
+// once the child is done, so a slow or hung ldd only holds up the input
+// it runs for. Inputs that are not ELF files are left to the parser.
+class LddPool
+{
+ public:
+    // the outcome of one run
+    struct Result
+    {
+        std::string output;     // what ldd wrote to stdout
+        int error;              // errno of a failed run, or 0
+        const char *call;       // the call that failed with it
+        int status;             // wait status
+        bool timed_out;         // killed at its timeout
+    };
+
+ private:
+    struct Child
+    {
+        std::string path;
+        pid_t pid;
+        int fd;                 // read end of its stdout
+        double deadline;        // when it is killed, or 0 for never
+        bool done;
+        Result result;
+    };
+
+    std::vector < Child * >children;    // in input order
+    std::map < std::string, std::vector < Child * > >waiting;  // by path
+    unsigned int limit;         // children running at once
+    double timeout;
+    bool started;
+    pthread_t tid;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;     // a child is done
+
+    // begin running a child, false if it isn't an ELF file or can't run
+    bool spawn(Child * c)
+    {
+        unsigned char s[EI_NIDENT + sizeof(Elf64_Half)];
+        int in = ::open(c->path.c_str(), O_RDONLY);
+        ssize_t n = in >= 0 ? ::read(in, s, sizeof(s)) : -1;
+
+        if (in >= 0)
+        {
+            ::close(in);
+        }
+
+        if (n <= 0 || !is_ELF_header(s, n))
+        {
+            return false;
+        }
+
+        int fds[2];
+
+        if (pipe2(fds, O_CLOEXEC) != 0)
+        {
+            c->result.error = errno;
+            c->result.call = "pipe2";
+            return false;
+        }
+
+        // stdout to the pipe, stdin from /dev/null, and a process group
+        // of its own, so the loader ldd runs dies with it
+        posix_spawn_file_actions_t actions;
+        posix_spawnattr_t attr;
+        const char *argv[] = { "ldd", "-v", c->path.c_str(), NULL };
+
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+        posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null",
+            O_RDONLY, 0);
+        posix_spawnattr_init(&attr);
+        posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+        posix_spawnattr_setpgroup(&attr, 0);
+
+        int err = posix_spawnp(&c->pid, "ldd", &actions, &attr,
+            (char *const *)argv, environ);
+
+        posix_spawnattr_destroy(&attr);
+        posix_spawn_file_actions_destroy(&actions);
+        ::close(fds[1]);
+
+        if (err != 0)
+        {
+            ::close(fds[0]);
+            c->result.error = err;
+            c->result.call = "posix_spawn";
+            return false;
+        }
+
+        fcntl(fds[0], F_SETFL, O_NONBLOCK);
+        c->fd = fds[0];
+        c->deadline = timeout > 0 ? now() + timeout : 0;
+
+        return true;
+    };
+
+    // read what a child has written, true once it has closed its stdout
+    static bool drain(Child * c)
+    {
+        return drain_pipe(c->fd, c->result.output);
+    };
+
+    // stop reading a child, once it has closed its stdout or is killed
+    static void hang_up(Child * c)
+    {
+        if (c->fd >= 0)
+        {
+            ::close(c->fd);
+            c->fd = -1;
+        }
+    };
+
+    // reap a child if it has exited, without waiting for it
+    static bool reap(Child * c)
+    {
+        return reap_child(c->pid, c->result.status);
+    };
+
+    // kill a child past its deadline, and its loader, and reap it
+    static void kill_child(Child * c)
+    {
+        hang_up(c);
+        kill_group(c->pid, c->result.status);
+        c->result.timed_out = true;
+    };
+
+    void finish(Child * c)
+    {
+        pthread_mutex_lock(&lock);
+        c->done = true;
+        pthread_cond_broadcast(&changed);
+        pthread_mutex_unlock(&lock);
+    };
+
+    // give up on the running children and those yet to run, failing
+    // each with the error of a call the pool itself depends on
+    void fail(std::vector < Child * >&running, size_t next, int err,
+        const char *call)
+    {
+        for (size_t i = 0; i < running.size(); i++)
+        {
+            kill_child(running[i]);
+            running[i]->result.timed_out = false;
+        }
+
+        running.insert(running.end(), children.begin() + next,
+            children.end());
+
+        for (size_t i = 0; i < running.size(); i++)
+        {
+            running[i]->result.error = err;
+            running[i]->result.call = call;
+            finish(running[i]);
+        }
+    };
+
+    void collect(void)
+    {
+        std::vector < Child * >running;
+        std::vector < struct pollfd > fds;
+        size_t next = 0;
+
+        for (;;)
+        {
+            while (running.size() < limit && next < children.size())
+            {
+                Child *c = children[next++];
+
+                if (spawn(c))
+                {
+                    running.push_back(c);
+                }
+                else
+                {
+                    finish(c);
+                }
+            }
+
+            if (running.empty())
+            {
+                break;
+            }
+
+            // wait for output, or until the next deadline; children which
+            // have closed their stdout but not yet exited are polled for
+            // every few milliseconds, as they have no fd to wait on
+            double t = now(), first = 0;
+            bool exiting = false;
+
+            fds.resize(running.size());
+
+            for (size_t i = 0; i < running.size(); i++)
+            {
+                fds[i].fd = running[i]->fd;
+                fds[i].events = POLLIN;
+                fds[i].revents = 0;
+                exiting = exiting || running[i]->fd < 0;
+
+                if (running[i]->deadline > 0 &&
+                    (first == 0 || running[i]->deadline < first))
+                {
+                    first = running[i]->deadline;
+                }
+            }
+
+            int wait = first == 0 ? -1 : first <= t ? 0 :
+                (int)((first - t) * 1000) + 1;
+
+            if (exiting && (wait < 0 || wait > 10))
+            {
+                wait = 10;
+            }
+
+            if (poll(&fds[0], fds.size(), wait) < 0 && errno != EINTR)
+            {
+                fail(running, next, errno, "poll");
+                break;
+            }
+
+            t = now();
+
+            for (size_t i = running.size(); i-- > 0;)
+            {
+                Child *c = running[i];
+
+                if (c->fd >= 0 && fds[i].revents != 0 && drain(c))
+                {
+                    hang_up(c);
+                }
+
+                // the timeout covers the exit as well as the output
+                bool exited = c->fd < 0 && reap(c);
+                bool late = !exited && c->deadline > 0 && t >= c->deadline;
+
+                if (late)
+                {
+                    kill_child(c);
+                }
+
+                if (exited || late)
+                {
+                    running.erase(running.begin() + i);
+                    finish(c);
+                }
+            }
+        }
+    };
+
+    static void *worker(void *arg)
+    {
+        ((LddPool *) arg)->collect();
+
+        return NULL;
+    };
+
+ public:
+    LddPool(unsigned int jobs, double seconds)
+    {
+        limit = jobs > 0 ? jobs : 1;
+        timeout = seconds;
+        started = false;
+        pthread_mutex_init(&lock, NULL);
+        pthread_cond_init(&changed, NULL);
+    };
+
+    ~LddPool()
+    {
+        if (started)
+        {
+            pthread_join(tid, NULL);
+        }
+
+        for (size_t i = 0; i < children.size(); i++)
+        {
+            delete children[i];
+        }
+
+        pthread_cond_destroy(&changed);
+        pthread_mutex_destroy(&lock);
+    };
+
+    // start running ldd -v on the ELF files among paths
+    void start(const std::vector < std::string > &paths)
+    {
+        for (size_t i = 0; i < paths.size(); i++)
+        {
+            Child *c = new Child;
+
+            c->path = paths[i];
+            c->pid = -1;
+            c->fd = -1;
+            c->deadline = 0;
+            c->done = false;
+            c->result.error = 0;
+            c->result.call = "";
+            c->result.status = 0;
+            c->result.timed_out = false;
+            children.push_back(c);
+            waiting[c->path].push_back(c);
+        }
+
+        int err = pthread_create(&tid, NULL, worker, this);
+
+        // with no thread to run them, each run fails, and its input with it
+        if (err != 0)
+        {
+            std::vector < Child * >none;
+
+            fail(none, 0, err, "pthread_create");
+            return;
+        }
+
+        started = true;
+    };
+
+    // wait for the next run for a path, false if none was started for it
+    bool take(const std::string & path, Result & result)
+    {
+        pthread_mutex_lock(&lock);
+
+        std::map < std::string, std::vector < Child * > >::iterator pw =
+            waiting.find(path);
+
+        if (pw == waiting.end() || pw->second.empty())
+        {
+            pthread_mutex_unlock(&lock);
+            return false;
+        }
+
+        Child *c = pw->second.front();
+
+        pw->second.erase(pw->second.begin());
+
+        while (!c->done)
+        {
+            pthread_cond_wait(&changed, &lock);
+        }
+
+        pthread_mutex_unlock(&lock);
+        result.output.swap(c->result.output);
+        result.error = c->result.error;
+        result.call = c->result.call;
+        result.status = c->result.status;
+        result.timed_out = c->result.timed_out;
+
+        return true;
+    };
+};
+
+/*************************
+ *  Parser
+ *************************/
+
+class Parser
+{
+ private:
+    std::string path;           // file pathname
+    FILE *fp;                   // open file pointer
+    bool is_pipe;               // ELF file run through ldd -v
+    LddPool::Result ldd;        // its output and exit status
+    const Options & opts;
+    bool is_native;             // ELF file read by the built in loader
+    bool real_path_pending;     // ldd needs to tell us the pathname
+    Node *cur_node;             // node to be used as from in edges
+    bool got_version_info;      // false until we see Version info:
+    Node *not_found_node;       // virtual node for unfound objects
+    LineReader reader;          // lines of fp
+    std::vector < StringRef > fields;   // fields of the current line
+    std::string input_path;     // path as given, for following documents
+    bool next_document_pending; // the next document's first line is unread
+    Stats *stats;               // counts, or NULL
+
+    // indexes over nodes and edges, the first node with a path and the
+    // first edge between two nodes win, as the parse refers back to them
+    std::map < unsigned int, Node * >node_index;
+    std::map < std::pair < Node *, Node * >, Edge * >edge_index;
+
+    // objects left out by the filters, by path, and the nodes of fold
+    // patterns, also indexed under the paths of the objects they stand for
+    std::set < unsigned int > filtered;
+    std::map < std::string, Node * >folds;
+
+    Node *add_node(Nodes & nodes, const std::string & path)
+    {
+        Node *node = nodes.add(path);
+
+        node_index.insert(std::make_pair(node->getPathId(), node));
+
+        return node;
+    };
+
+    Edge *add_edge(Edges & edges, Node * from, Node * to)
+    {
+        Edge *edge = edges.add(from, to);
+
+        edge_index.insert(std::make_pair(std::make_pair(from, to), edge));
+
+        return edge;
+    };
+
+    // change a node's path, keeping the node index in step
+    void set_node_path(Node * node, std::string & path)
+    {
+        std::map < unsigned int, Node * >::iterator pn =
+            node_index.find(node->getPathId());
+
+        if (pn != node_index.end() && pn->second == node)
+        {
+            node_index.erase(pn);
+        }
+
+        node->setPath(path);
+        node_index.insert(std::make_pair(node->getPathId(), node));
+    };
+
+    Node *find_existing_node(std::string & path)
+    {
+        std::map < unsigned int, Node * >::iterator pn =
+            node_index.find(strings.find(path));
+
+        if (pn != node_index.end())
+        {
+            return pn->second;
+        }
+
+        throw InputError(path, "cannot find prior reference!");
+    };
+
+    Edge *find_edge_from_to(Node * from, Node * to)
+    {
+        std::map < std::pair < Node *, Node * >, Edge * >::iterator pe =
+            edge_index.find(std::make_pair(from, to));
+
+        return pe != edge_index.end() ? pe->second : NULL;
+    }
+
+    bool process_line(Nodes & nodes, Edges & edges)
+    {
+        StringRef line;
+
+        if (!reader.next(line))
+        {
+            return false;
+        }
+
+        if (stats != NULL)
+        {
+            stats->lines++;
+        }
+
+        // split into fields, f, which are views of the line
+        std::vector < StringRef > &f = fields;
+
+        split_fields(line, f);
+
+        // input:
+        if (f.size() == 0)
+        {
+            return true;
+        }
+
+        // input: <path>: at the start of a line heads a document, as ldd
+        // prints when given many files; once past the top of a document,
+        // so does a line from the top of the ldd -v output
+        if (opts.split_documents && got_version_info &&
+            ((f.size() == 1 && line[0] == f[0][0] && ends_with(f[0], ":")) ||
+                f.size() == 2 || f.size() == 3 ||
+                (f.size() == 4 && f[1] == "=>")))
+        {
+            reader.unread();
+            next_document_pending = true;
+            return false;
+        }
+
+        if (opts.split_documents && f.size() == 1 && line[0] == f[0][0] &&
+            ends_with(f[0], ":"))
+        {
+            std::string field = trim_front(trim_end(f[0], ":"), "./").str();
+
+            DEBUG_OUT(std::cerr << "document " << field << std::endl);
+            set_node_path(nodes[0], field);
+            path = field;
+            return true;
+        }
+
+        // input: not a <...>
+        if (f.size() == 4 && f[0] == "not" && f[1] == "a")
+        {
+            throw InputError(path, "not a dynamically loaded file");
+        }
+
+        // input: <path>: <libpath>: version `<symbol>' not found (required by <path>)
+        if (f.size() == 5 && ends_with(f[0], ":") && ends_with(f[1], ":") &&
+            f[2] == "version" && f[4] == "not")
+        {
+            std::cerr <<
+                "some symbol versions are unresolvable, input: " << line <<
+                std::endl;
+            return true;
+        }
+
+        // input: Version information:
+        if (f.size() == 2 && f[0] == "Version" && f[1] == "information:")
+        {
+            got_version_info = true;
+            return true;
+        }
+
+        // input: <lib> (<loadaddr>)
+        // input: <lib> =>  (<loadaddr>)
+        // input: <lib> => <path> (<loadaddr>)
+        // input: <lib> => not found
+        if (got_version_info == false && (f.size() == 2 || f.size() == 3 ||
+                f.size() == 4))
+        {
+            StringRef field(f.size() == 4 ? f[2] : f[0]);
+
+            // input: <lib> => not found
+            bool not_found = f.size() == 4 && f[2] == "not" && f[3] == "found";
+
+            if (not_found)
+            {
+                field = f[0];
+            }
+
+            std::string sub_path(trim_front(field, "./").str());
+            std::string fold;
+            Filter filter = filter_name(opts, f[0].str(), fold);
+
+            // ldd has found them already, but filtered objects are not
+            // added, or are added as the node of their fold pattern
+            if (filter != FILTER_FOLLOW)
+            {
+                filtered.insert(strings.intern(sub_path));
+            }
+
+            if (filter == FILTER_FOLD)
+            {
+                Node *&fold_node = folds[fold];
+
+                if (fold_node == NULL)
+                {
+                    fold_node = add_node(nodes, fold);
+                }
+
+                node_index.insert(std::make_pair(strings.intern(sub_path),
+                        fold_node));
+
+                if (find_edge_from_to(cur_node, fold_node) == NULL)
+                {
+                    add_edge(edges, cur_node, fold_node);
+                }
+            }
+
+            if (filter != FILTER_FOLLOW)
+            {
+                return true;
+            }
+
+            if (not_found)
+            {
+                std::cerr << f[0] << ": shared object not found, input: " <<
+                    line << std::endl;
+            }
+
+            Node *sub_node = add_node(nodes, sub_path);
+
+            add_edge(edges, cur_node, sub_node);
+
+            // TODO test
+            if (not_found)
+            {
+                if (not_found_node == NULL)
+                {
+                    not_found_node = add_node(nodes, "not found");
+                }
+
+                add_edge(edges, sub_node, not_found_node);
+            }
+
+            return true;
+        }
+
+        if (got_version_info == false)
+        {
+            std::cerr << path << ": unrecognized line: " << line << std::endl;
+            return true;
+        }
+
+        // input: <path>:
+        if (f.size() == 1 && ends_with(f[0], ":"))
+        {
+            std::string field = trim_front(trim_end(f[0], ":"), "./").str();
+
+            // we've been waiting for the ldd output to tell us what the
+            // real file's path is.
+            if (real_path_pending)
+            {
+                DEBUG_OUT(std::cerr << "reset path " << path << " to " <<
+                    field << std::endl);
+                set_node_path(nodes[0], field);
+                path = field;
+                real_path_pending = false;
+            }
+
+            // the requirements of filtered objects are skipped
+            bool is_filtered = filtered.find(strings.find(field)) !=
+                filtered.end();
+
+            cur_node = is_filtered ? NULL : find_existing_node(field);
+
+            return true;
+        }
+
+        // input: <shared object> (<version>) => <path>
+        if (f.size() != 4)
+        {
+            std::cerr << path << ": unrecognized line: " << line << std::endl;
+            return true;
+        }
+
+        std::string version(trim_outer_parens(f[1]).str());
+        std::string field = trim_front(f[3], "./").str();
+
+        if (cur_node == NULL)
+        {
+            return true;
+        }
+
+        std::map < unsigned int, Node * >::iterator pn =
+            node_index.find(strings.find(field));
+
+        // requirements of dropped objects are dropped, and those of
+        // folded objects go to their fold node
+        if (pn == node_index.end() &&
+            filtered.find(strings.find(field)) != filtered.end())
+        {
+            return true;
+        }
+
+        Node *sub_node = pn != node_index.end() ? pn->second :
+            find_existing_node(field);
+
+        // add label to existing or new edge
+        Edge *edge = find_edge_from_to(cur_node, sub_node);
+
+        if (edge == NULL)
+        {
+            edge = add_edge(edges, cur_node, sub_node);
+        }
+
+        edge->addLabel(version);
+
+        return true;
+    };
+
+    // erase unlabeled edges with a to node for which there is a labeled
+    // edge pointing to it, in linear passes marking the nodes first
+
+    void trim_unlabeled_edges(Edges & edges)
+    {
+        DEBUG_OUT(std::cerr << "edge count " << edges.size() << std::endl);
+
+        Edges::iterator kept = edges.begin();
+
+        for (Edges::iterator pe = edges.begin(); pe != edges.end(); ++pe)
+        {
+            (*pe)->getTo()->setLabeledIn(false);
+        }
+
+        for (Edges::iterator pe = edges.begin(); pe != edges.end(); ++pe)
+        {
+            if ((*pe)->isLabeled())
+            {
+                (*pe)->getTo()->setLabeledIn(true);
+            }
+        }
+
+        for (Edges::iterator pe = edges.begin(); pe != edges.end(); ++pe)
+        {
+            if (!(*pe)->isLabeled() && (*pe)->getTo()->isLabeledIn())
+            {
+                DEBUG_OUT(std::cerr << "removing edge: from " <<
+                    (*pe)->getFrom()->getPath() << " to " <<
+                    (*pe)->getTo()->getPath() << std::endl);
+                continue;
+            }
+
+            *kept++ = *pe;
+        }
+
+        edges.erase(kept, edges.end());
+        DEBUG_OUT(std::cerr << "edge count " << edges.size() << std::endl);
+    };
+
+    // ldd -v lists everything loaded without depths, so for its output
+    // the depth limit is applied once the graph is read: nodes further
+    // from the root than the limit and the edges out of nodes at it go,
+    // as the built in loader would not have searched for them
+    void limit_depth(Nodes & nodes, Edges & edges)
+    {
+        std::map < Node *, std::vector < Edge * > >out;
+        std::map < Node *, int >depth;
+        std::vector < Node * >queue;
+
+        for (Edges::iterator pe = edges.begin(); pe != edges.end(); ++pe)
+        {
+            out[(*pe)->getFrom()].push_back(*pe);
+        }
+
+        if (nodes.size() > 0)
+        {
+            depth[nodes[0]] = 0;
+            queue.push_back(nodes[0]);
+        }
+
+        // breadth first from the root, as far as the limit
+        for (size_t i = 0; i < queue.size(); i++)
+        {
+            int d = depth[queue[i]];
+            std::vector < Edge * >&e = out[queue[i]];
+
+            for (size_t j = 0; j < e.size() && d < opts.max_depth; j++)
+            {
+                if (depth.insert(std::make_pair(e[j]->getTo(), d + 1)).second)
+                {
+                    queue.push_back(e[j]->getTo());
+                }
+            }
+        }
+
+        std::vector < Node * >kept_nodes;
+        std::vector < Edge * >kept_edges;
+
+        for (Nodes::iterator pn = nodes.begin(); pn != nodes.end(); ++pn)
+        {
+            if (depth.find(*pn) != depth.end())
+            {
+                kept_nodes.push_back(*pn);
+            }
+        }
+
+        for (Edges::iterator pe = edges.begin(); pe != edges.end(); ++pe)
+        {
+            std::map < Node *, int >::iterator pd =
+                depth.find((*pe)->getFrom());
+
+            if (pd != depth.end() && pd->second < opts.max_depth)
+            {
+                kept_edges.push_back(*pe);
+            }
+        }
+
+        nodes.assign(kept_nodes);
+        edges.assign(kept_edges);
+    };
+
+ public:
+    Parser(std::string p, const Options & o):opts(o)
+    {
+        path = p;
+        input_path = p;
+        next_document_pending = false;
+        fp = NULL;
+        is_pipe = false;
+        is_native = false;
+        real_path_pending = false;
+        cur_node = NULL;
+        got_version_info = false;
+        not_found_node = NULL;
+        stats = NULL;
+    };
+
+    // an input given up on is left open
+    ~Parser()
+    {
+        if (fp != NULL && fp != stdin)
+        {
+            fclose(fp);
+        }
+    };
+
+    void setStats(Stats * s)
+    {
+        stats = s;
     };
 
     void open(void)
     {
-        // determine if input is stdin, executable or shared object, or regular
-        // file input. executables and shared objects are run through ldd -v to
-        // generate the input.
-        if (path == "-")
+        // determine if input is stdin, executable or shared object, or regular
+        // file input. executables and shared objects are read by the built in
+        // loader, or are run through ldd -v to generate the input.
+        // the inputs of an archived image are its members, read natively
+        if (opts.image != NULL)
+        {
+            is_native = true;
+            return;
+        }
+
+        if (path == "-")
+        {
+            fp = stdin;
+            real_path_pending = true;
+            return;
+        }
+
+        bool is_elf = is_ELF_file(path);
+
+        if (is_elf && !opts.use_ldd)
+        {
+            is_native = true;
+            return;
+        }
+
+        if (is_elf)
+        {
+            // executable files and files with .so in the name, run by
+            // the batch's ldd pool, or by a pool of their own
+            LddPool single(1, opts.ldd_timeout);
+
+            if (opts.ldd == NULL || !opts.ldd->take(path, ldd))
+            {
+                single.start(std::vector < std::string > (1, path));
+                single.take(path, ldd);
+            }
+
+            is_pipe = true;
+
+            if (ldd.error != 0)
+            {
+                throw InputError(path, std::string(ldd.call) + ": " +
+                    strerror(ldd.error));
+            }
+
+            return;
+        }
+
+        if (access(path.c_str(), R_OK) == 0)
+        {
+            fp = fopen(path.c_str(), "r");
+            real_path_pending = true;
+        }
+
+        if (fp == NULL)
+        {
+            throw InputError(path, std::string("fopen: ") + strerror(errno));
+        }
+    };
+
+    void parse(Nodes & nodes, Edges & edges)
+    {
+        // create a root node for the input file, also referred to as
+        // nodes[0], named inside the --sysroot image if it is in one
+        cur_node = add_node(nodes, trim_front(is_native ?
+                image_path(opts, path) : path, "./"));
+
+        if (is_native)
+        {
+            ElfLoader loader(path, cur_node, opts);
+
+            loader.setStats(stats);
+            loader.load(nodes, edges);
+        }
+        else
+        {
+            // read and process lines until EOF, mapping regular files
+            if (is_pipe)
+            {
+                reader.attachBuffer(ldd.output);
+            }
+            else if (fp == stdin || !reader.attachMapped(fp))
+            {
+                reader.attach(fp);
+            }
+
+            while (process_line(nodes, edges))
+            {
+            }
+        }
+
+        // ELF files, read natively or through ldd, may be run
+        if (opts.profile_runs > 0 && (is_native || is_pipe))
+        {
+            Profiler profiler(path, opts.profile_runs, opts.ldd_timeout);
+
+            profiler.profile(nodes, edges);
+        }
+    };
+
+    // when the input holds another document, reset for it and return
+    // true, updating the p argument with the path of the last document
+    bool next_document(std::string & p)
+    {
+        if (!next_document_pending)
+        {
+            return false;
+        }
+
+        p = path;
+        path = input_path;
+        real_path_pending = true;
+        cur_node = NULL;
+        got_version_info = false;
+        not_found_node = NULL;
+        node_index.clear();
+        edge_index.clear();
+        filtered.clear();
+        folds.clear();
+        next_document_pending = false;
+
+        return true;
+    };
+
+    // note, updates the p argument with final path
+    // as output by ldd
+    void close(std::string & p)
+    {
+        if (is_native)
+        {
+            p = path;
+            return;
+        }
+
+        // if error, quit while we're behind
+        if (reader.error())
+        {
+            throw InputError(path, "aborted");
+        }
+
+        if (is_pipe && ldd.timed_out)
+        {
+            std::ostringstream reason;
+
+            reason << "ldd -v timed out after " << opts.ldd_timeout <<
+                " seconds";
+            throw InputError(path, reason.str());
+        }
+
+        if (is_pipe && ldd.status != 0)
+        {
+            std::ostringstream reason;
+
+            if (WIFSIGNALED(ldd.status))
+            {
+                reason << "ldd -v killed by signal " << WTERMSIG(ldd.status);
+            }
+            else
+            {
+                reason << "ldd -v exited with status " <<
+                    WEXITSTATUS(ldd.status);
+            }
+
+            throw InputError(path, reason.str());
+        }
+
+        FILE *f = fp;
+
+        fp = NULL;
+
+        if (!is_pipe && fclose(f) != 0)
+        {
+            throw InputError(path, std::string("fclose: ") + strerror(errno));
+        }
+
+        p = path;
+    };
+
+    void finalize(Nodes & nodes, Edges & edges)
+    {
+        // Debug dump
+        for (Nodes::iterator pn = nodes.begin(); pn != nodes.end(); ++pn)
+        {
+            DEBUG_OUT(std::cerr << "node: path " << (*pn)->getPath() <<
+                std::endl);
+        }
+
+        for (Edges::iterator pe = edges.begin(); pe != edges.end(); ++pe)
+        {
+            DEBUG_OUT(std::cerr << "edge: from " <<
+                (*pe)->getFrom()->getPath() << " to " <<
+                (*pe)->getTo()->getPath() << " labels " <<
+                (*pe)->getLabels(" ") << std::endl);
+        }
+
+        trim_unlabeled_edges(edges);
+
+        if (!is_native && opts.max_depth >= 0)
+        {
+            limit_depth(nodes, edges);
+        }
+    };
+};
+
+/*************************
+ *  Graph passes
+ *************************/
+
+// Bitset is a set of numbers below a fixed bound, for reachability
+class Bitset
+{
+ private:
+    std::vector < uint64_t > words;
+
+ public:
+    Bitset(size_t n = 0):words((n + 63) / 64)
+    {
+    };
+
+    void set(size_t i)
+    {
+        words[i >> 6] |= (uint64_t) 1 << (i & 63);
+    };
+
+    bool test(size_t i) const
+    {
+        return words[i >> 6] >> (i & 63) & 1;
+    };
+
+    // add the members of a set of the same bound
+    void merge(const Bitset & b)
+    {
+        for (size_t i = 0; i < words.size(); i++)
+        {
+            words[i] |= b.words[i];
+        }
+    };
+};
+
+// GraphShape numbers the nodes of a graph in list order, and lists the
+// nodes each node has edges to
+struct GraphShape
+{
+    std::vector < Node * >node;
+    std::map < Node *, unsigned int >number;
+    std::vector < std::vector < unsigned int > > out;
+    std::vector < unsigned int > from;  // of each edge
+    std::vector < unsigned int > to;
+
+    GraphShape(Nodes & nodes, Edges & edges)
+    {
+        node.assign(nodes.begin(), nodes.end());
+
+        for (size_t i = 0; i < node.size(); i++)
+        {
+            number.insert(std::make_pair(node[i], i));
+        }
+
+        out.resize(node.size());
+
+        for (Edges::iterator pe = edges.begin(); pe != edges.end(); ++pe)
+        {
+            unsigned int f = number[(*pe)->getFrom()];
+            unsigned int t = number[(*pe)->getTo()];
+
+            from.push_back(f);
+            to.push_back(t);
+            out[f].push_back(t);
+        }
+    };
+};
+
+// number the strongly connected components of a graph, returning their
+// count; the numbering is in reverse topological order, so every edge
+// between components leads to a lower number. This is Tarjan's algorithm
+// with an explicit stack, as chains of objects can be long.
+static unsigned int strong_components(const std::vector < std::vector <
+    unsigned int > >&out, std::vector < unsigned int >&comp)
+{
+    const unsigned int unset = (unsigned int)-1;
+    size_t n = out.size();
+    std::vector < unsigned int >index(n, unset), low(n), stack;
+    std::vector < bool > on_stack(n);
+    std::vector < std::pair < unsigned int, size_t > >call;
+    unsigned int next_index = 0, count = 0;
+
+    comp.assign(n, 0);
+
+    for (unsigned int r = 0; r < n; r++)
+    {
+        if (index[r] != unset)
+        {
+            continue;
+        }
+
+        index[r] = low[r] = next_index++;
+        stack.push_back(r);
+        on_stack[r] = true;
+        call.push_back(std::make_pair(r, 0));
+
+        while (!call.empty())
+        {
+            unsigned int v = call.back().first;
+
+            // visit the next edge of v
+            if (call.back().second < out[v].size())
+            {
+                unsigned int w = out[v][call.back().second++];
+
+                if (index[w] == unset)
+                {
+                    index[w] = low[w] = next_index++;
+                    stack.push_back(w);
+                    on_stack[w] = true;
+                    call.push_back(std::make_pair(w, 0));
+                }
+                else if (on_stack[w])
+                {
+                    low[v] = std::min(low[v], index[w]);
+                }
+
+                continue;
+            }
+
+            call.pop_back();
+
+            if (!call.empty())
+            {
+                unsigned int u = call.back().first;
+
+                low[u] = std::min(low[u], low[v]);
+            }
+
+            // v heads a component: pop it
+            if (low[v] == index[v])
+            {
+                unsigned int w;
+
+                do
+                {
+                    w = stack.back();
+                    stack.pop_back();
+                    on_stack[w] = false;
+                    comp[w] = count;
+                }
+                while (w != v);
+
+                count++;
+            }
+        }
+    }
+
+    return count;
+}
+
+// replace each cycle of objects needing each other by a single node named
+// for its members, joining the edges into and out of it
+static void collapse_cycles(Nodes & nodes, Edges & edges)
+{
+    GraphShape g(nodes, edges);
+    std::vector < unsigned int >comp;
+    unsigned int count = strong_components(g.out, comp);
+
+    if (count == g.node.size())
+    {
+        return;
+    }
+
+    std::vector < std::vector < unsigned int > >members(count);
+
+    for (unsigned int i = 0; i < g.node.size(); i++)
+    {
+        members[comp[i]].push_back(i);
+    }
+
+    // the node of each member of a cycle, listed where its first member was
+    std::vector < Node * >rep(g.node);
+    std::vector < Node * >list;
+    std::vector < bool > listed(count);
+
+    for (unsigned int i = 0; i < g.node.size(); i++)
+    {
+        std::vector < unsigned int >&m = members[comp[i]];
+
+        if (m.size() == 1)
+        {
+            list.push_back(g.node[i]);
+            continue;
+        }
+
+        if (listed[comp[i]])
+        {
+            continue;
+        }
+
+        std::string name("{");
+        LoadCost cost;
+        int order = -1;
+
+        for (size_t j = 0; j < m.size(); j++)
+        {
+            Node *member = g.node[m[j]];
+            int o = member->getLoadOrder();
+
+            name += (j > 0 ? ", " : "") + member->getPath();
+            cost.add(member->getCost());
+            order = o >= 0 && (order < 0 || o < order) ? o : order;
+        }
+
+        Node *cycle = nodes.create(name + "}");
+
+        cycle->setCost(cost);
+        cycle->setLoadOrder(order);
+
+        if (i == 0)
+        {
+            cycle->setProfile(g.node[0]->getProfile());
+        }
+
+        for (size_t j = 0; j < m.size(); j++)
+        {
+            rep[m[j]] = cycle;
+        }
+
+        list.push_back(cycle);
+        listed[comp[i]] = true;
+    }
+
+    // keep the edges between other nodes, drop those within a cycle, and
+    // join those into and out of one
+    std::map < std::pair < Node *, Node * >, Edge * >joined;
+    std::vector < Edge * >kept;
+    size_t n = edges.size();
+
+    for (size_t i = 0; i < n; i++)
+    {
+        Edge *e = edges[i];
+        Node *f = rep[g.from[i]];
+        Node *t = rep[g.to[i]];
+
+        if (f == e->getFrom() && t == e->getTo())
+        {
+            kept.push_back(e);
+        }
+        else if (f != t)
+        {
+            Edge *&j = joined[std::make_pair(f, t)];
+
+            if (j == NULL)
+            {
+                j = edges.add(f, t);
+                kept.push_back(j);
+            }
+
+            j->merge(e);
+        }
+    }
+
+    nodes.assign(list);
+    edges.assign(kept);
+}
+
+// remove each edge u -> v where v is also reached from u by a longer
+// path, keeping edges within cycles. Reachability is a bitset for each
+// strongly connected component, built from the components it leads to.
+static void reduce_edges(Nodes & nodes, Edges & edges)
+{
+    GraphShape g(nodes, edges);
+    std::vector < unsigned int >comp;
+    unsigned int count = strong_components(g.out, comp);
+
+    // the components each component has edges to, and its edges
+    std::vector < std::vector < unsigned int > >next(count);
+    std::vector < std::vector < size_t > >out_edges(count);
+
+    for (size_t i = 0; i < g.from.size(); i++)
+    {
+        unsigned int cf = comp[g.from[i]];
+        unsigned int ct = comp[g.to[i]];
+
+        if (cf != ct)
+        {
+            next[cf].push_back(ct);
+            out_edges[cf].push_back(i);
+        }
+    }
+
+    // the components reached from each by one or more edges: edges lead
+    // to lower numbers, so those are complete first
+    std::vector < Bitset > reach(count, Bitset(count));
+    std::vector < bool > redundant(g.from.size());
+
+    for (unsigned int c = 0; c < count; c++)
+    {
+        Bitset beyond(count);   // reached in two or more edges
+
+        for (size_t j = 0; j < next[c].size(); j++)
+        {
+            reach[c].set(next[c][j]);
+            beyond.merge(reach[next[c][j]]);
+        }
+
+        reach[c].merge(beyond);
+
+        for (size_t j = 0; j < out_edges[c].size(); j++)
+        {
+            size_t e = out_edges[c][j];
+
+            redundant[e] = beyond.test(comp[g.to[e]]);
+        }
+    }
+
+    Edges::iterator kept = edges.begin();
+
+    for (size_t i = 0; i < g.from.size(); i++)
+    {
+        if (!redundant[i])
+        {
+            *kept++ = edges[i];
+        }
+    }
+
+    edges.erase(kept, edges.end());
+}
+
+// find the immediate dominator of each node: the last node that every
+// path to it from a root passes through, where the roots are the first
+// node and any others nothing needs. The nodes a node dominates would
+// not be loaded without it. This is the iterative algorithm of Cooper,
+// Harvey and Kennedy over a reverse postorder.
+static void find_dominators(Nodes & nodes, Edges & edges)
+{
+    GraphShape g(nodes, edges);
+    const unsigned int unset = (unsigned int)-1;
+    unsigned int n = g.node.size();
+    unsigned int root = n;      // a virtual root above the real ones
+    std::vector < std::vector < unsigned int > >pred(n + 1);
+    std::vector < std::vector < unsigned int > >out(g.out);
+
+    if (n == 0)
+    {
+        return;
+    }
+
+    out.resize(n + 1);
+
+    for (unsigned int i = 0; i < g.from.size(); i++)
+    {
+        pred[g.to[i]].push_back(g.from[i]);
+    }
+
+    for (unsigned int i = 0; i < n; i++)
+    {
+        if (i == 0 || pred[i].empty())
+        {
+            out[root].push_back(i);
+            pred[i].push_back(root);
+        }
+    }
+
+    // postorder numbers, by an explicit depth first search
+    std::vector < unsigned int >post(n + 1, unset), order;
+    std::vector < bool > seen(n + 1);
+    std::vector < std::pair < unsigned int, size_t > >call;
+
+    call.push_back(std::make_pair(root, 0));
+    seen[root] = true;
+
+    while (!call.empty())
+    {
+        unsigned int v = call.back().first;
+
+        if (call.back().second < out[v].size())
+        {
+            unsigned int w = out[v][call.back().second++];
+
+            if (!seen[w])
+            {
+                seen[w] = true;
+                call.push_back(std::make_pair(w, 0));
+            }
+
+            continue;
+        }
+
+        post[v] = order.size();
+        order.push_back(v);
+        call.pop_back();
+    }
+
+    std::vector < unsigned int >idom(n + 1, unset);
+    bool changed = true;
+
+    idom[root] = root;
+
+    while (changed)
+    {
+        changed = false;
+
+        // in reverse postorder, after the root
+        for (size_t k = order.size() - 1; k-- > 0;)
+        {
+            unsigned int v = order[k];
+            unsigned int d = unset;
+
+            for (size_t j = 0; j < pred[v].size(); j++)
+            {
+                unsigned int p = pred[v][j];
+
+                if (idom[p] == unset)
+                {
+                    continue;
+                }
+
+                // walk the two up the dominator tree until they meet
+                while (d != unset && d != p)
+                {
+                    while (post[p] < post[d])
+                    {
+                        p = idom[p];
+                    }
+
+                    while (post[d] < post[p])
+                    {
+                        d = idom[d];
+                    }
+                }
+
+                d = p;
+            }
+
+            if (idom[v] != d)
+            {
+                idom[v] = d;
+                changed = true;
+            }
+        }
+    }
+
+    // sum what each node dominates, children before their dominators
+    std::vector < unsigned int >count(n + 1);
+    std::vector < uint64_t > weight(n + 1);
+
+    for (unsigned int i = 0; i < n; i++)
+    {
+        weight[i] = g.node[i]->getCost().weight();
+    }
+
+    for (size_t k = 0; k + 1 < order.size(); k++)
+    {
+        unsigned int v = order[k];
+
+        count[idom[v]] += count[v] + 1;
+        weight[idom[v]] += weight[v];
+    }
+
+    for (unsigned int i = 0; i < n; i++)
+    {
+        Node *d = idom[i] == unset || idom[i] == root ? NULL : g.node[idom[i]];
+
+        g.node[i]->setDominance(d, count[i], weight[i]);
+    }
+}
+
+// run the graph passes the options ask for on a finished graph
+void run_passes(Nodes & nodes, Edges & edges, const Options & opts)
+{
+    if (opts.collapse_cycles)
+    {
+        collapse_cycles(nodes, edges);
+    }
+
+    // dominators before reduction, which would hide the other paths
+    if (opts.dominators)
+    {
+        find_dominators(nodes, edges);
+    }
+
+    if (opts.reduce)
+    {
+        reduce_edges(nodes, edges);
+    }
+}
+
+// describe an input's graph for the info block
+std::string info_label(std::string & path, Nodes & nodes, Edges & edges)
+{
+    std::ostringstream s;
+
+    s << "file: " << path << "\\n" << "nodes: " << nodes.size() << "\\n" <<
+        "edges: " << edges.size();
+
+    LoadCost total;
+    unsigned int measured = 0, bind_now = 0, prelinked = 0;
+
+    for (Nodes::iterator pn = nodes.begin(); pn != nodes.end(); ++pn)
+    {
+        const LoadCost & c = (*pn)->getCost();
+
+        if (c.measured)
+        {
+            total.add(c);
+            measured++;
+            bind_now += c.bind_now;
+            prelinked += c.prelinked;
+        }
+    }
+
+    if (measured > 0)
+    {
+        s << "\\nrelocations: " << total.relative << " relative, " <<
+            total.symbolic << " symbolic, " << total.plt << " plt" <<
+            "\\nsymbol lookups: " << total.lookups <<
+            "\\nbind now: " << bind_now << " of " << measured <<
+            "\\nprelinked: " << prelinked << " of " << measured <<
+            "\\nload size: " << (total.load_size + 1023) / 1024 << " KiB";
+    }
+
+    const StartupProfile & p = nodes.size() > 0 ? nodes[0]->getProfile() :
+        StartupProfile();
+
+    if (p.runs > 0)
+    {
+        s << "\\nruns: " << p.runs <<
+            "\\nstartup cycles: " << p.startup_min << " min, " <<
+            p.startup_sum / p.runs << " mean" <<
+            "\\nrelocation cycles: " << p.relocation_min << " min, " <<
+            p.relocation_sum / p.runs << " mean" <<
+            "\\nload cycles: " << p.load_min << " min, " <<
+            p.load_sum / p.runs << " mean" <<
+            "\\nrelocations: " << p.relocations << ", " << p.relative <<
+            " relative";
+    }
+
+    return s.str();
+}
+
+// open a DOT attribute list before its first attribute, or separate the
+// next one
+static void dot_attribute(std::string & buf, bool & open)
+{
+    buf += open ? ", " : " [";
+    open = true;
+}
+
+// end a DOT statement, closing its attribute list if one was opened
+static void dot_end(std::string & buf, bool open)
+{
+    buf += open ? "];\n" : ";\n";
+}
+
+// the DOT ids print_output gives nodes: n and the node's place in the
+// list, formatted once for each node. Edges find the numbers of their
+// ends by a binary search of the nodes in address order.
+class DotIds
+{
+ private:
+    std::vector < std::pair < Node *, unsigned int > >number;
+    std::vector < std::string > id;
+
+ public:
+    DotIds(Nodes & nodes)
+    {
+        char num[16];
+
+        for (Nodes::iterator pn = nodes.begin(); pn != nodes.end(); ++pn)
+        {
+            snprintf(num, sizeof(num), "n%u", (unsigned int)id.size());
+            number.push_back(std::make_pair(*pn, id.size()));
+            id.push_back(num);
+        }
+
+        std::sort(number.begin(), number.end());
+    };
+
+    // the id of the node at place i in the list
+    const std::string & get(size_t i)
+    {
+        return id[i];
+    };
+
+    // append the id of a node, or its quoted path if it is not listed
+    void append(std::string & buf, Node * node)
+    {
+        std::vector < std::pair < Node *, unsigned int > >::iterator pn =
+            std::lower_bound(number.begin(), number.end(),
+            std::make_pair(node, 0u));
+
+        if (pn == number.end() || pn->first != node)
+        {
+            node->appendPathQuoted(buf);
+            return;
+        }
+
+        buf += id[pn->second];
+    };
+};
+
+// The graph is built in one buffer and written at once. Each node is
+// given a short id, n and its place in the list, with its path as its
+// label, so an edge names its ends in a few bytes rather than by their
+// quoted paths; each edge's labels are joined once, straight into the
+// buffer, so nothing is allocated per edge beyond the buffer's growth.
+void print_output(std::ostream & out, std::string info, Nodes & nodes,
+    Edges & edges)
+{
+    std::string buf;
+    char num[160];
+    DotIds ids(nodes);
+
+    buf.reserve(64 * nodes.size() + 64 * edges.size() + info.size() + 64);
+
+    // Begin output file
+    buf += "digraph G {\n";
+    buf += "info_block [shape=box, label=\"";
+    buf += info;
+    buf += "\"];\n";
+
+    // with load costs, shade nodes from white to red by their share of
+    // the heaviest object's cost
+    uint64_t heaviest = 0, total = 0;
+
+    for (Nodes::iterator pn = nodes.begin(); pn != nodes.end(); ++pn)
+    {
+        heaviest = std::max(heaviest, (*pn)->getCost().weight());
+        total += (*pn)->getCost().weight();
+    }
+
+    // For each node, emit a digraph node, labeled with its path and, with
+    // dominators, the object it is loaded only through and what it alone
+    // brings in
+    for (Nodes::iterator pn = nodes.begin(); pn != nodes.end(); ++pn)
+    {
+        const LoadCost & c = (*pn)->getCost();
+        Node *idom = (*pn)->getDominator();
+        bool open = false;
+
+        buf += ids.get(pn - nodes.begin());
+        dot_attribute(buf, open);
+        buf += "label=\"";
+        buf += (*pn)->getPath();
+
+        if (idom != NULL)
+        {
+            const std::string & d = idom->getPath();
+
+            buf += "\\nonly via ";
+            buf.append(d, d.rfind('/') + 1, std::string::npos);
+        }
+
+        if ((*pn)->getDominated() > 0)
+        {
+            snprintf(num, sizeof(num), "\\ndominates %u",
+                (*pn)->getDominated());
+            buf += num;
+
+            if (total > 0)
+            {
+                snprintf(num, sizeof(num), ", %llu%% of load cost",
+                    (unsigned long long)((*pn)->getDominatedWeight() *
+                        100 / total));
+                buf += num;
+            }
+        }
+
+        buf += "\"";
+
+        if (c.measured)
+        {
+            dot_attribute(buf, open);
+            buf += "style=filled";
+            dot_attribute(buf, open);
+            snprintf(num, sizeof(num), "fillcolor=\"0.000 %.3f 1.000\"",
+                heaviest > 0 ? (double)c.weight() / heaviest : 0.0);
+            buf += num;
+            dot_attribute(buf, open);
+            snprintf(num, sizeof(num), "tooltip=\"%llu relative, "
+                "%llu symbolic, %llu plt relocations\\n%llu symbol lookups",
+                (unsigned long long)c.relative,
+                (unsigned long long)c.symbolic, (unsigned long long)c.plt,
+                (unsigned long long)c.lookups);
+            buf += num;
+            buf += c.bind_now ? ", bind now" : "";
+            buf += c.prelinked ? ", prelinked" : "";
+            snprintf(num, sizeof(num), "\\n%llu KiB loaded\"",
+                (unsigned long long)(c.load_size + 1023) / 1024);
+            buf += num;
+        }
+
+        if ((*pn)->getLoadOrder() >= 0)
+        {
+            dot_attribute(buf, open);
+            snprintf(num, sizeof(num), "xlabel=\"load %d\"",
+                (*pn)->getLoadOrder());
+            buf += num;
+        }
+
+        dot_end(buf, open);
+    }
+
+    // Emit all edges
+
+    for (Edges::iterator pe = edges.begin(); pe != edges.end(); ++pe)
+    {
+        bool labeled = (*pe)->isLabeled();
+        bool open = false;
+
+        // emit the basic digraph edge
+        ids.append(buf, (*pe)->getFrom());
+        buf += " -> ";
+        ids.append(buf, (*pe)->getTo());
+
+        // make the digraph edge solid if labeled, and dotted if not.
+
+        if (!labeled)
+        {
+            dot_attribute(buf, open);
+            buf += "style=dotted";
+        }
+
+        if ((*pe)->isUnused())
+        {
+            dot_attribute(buf, open);
+            buf += "color=red";
+        }
+
+        if (labeled || (*pe)->hasSymbols())
+        {
+            dot_attribute(buf, open);
+            buf += "label=\"";
+            (*pe)->appendLabels(buf, "\\n");
+
+            if ((*pe)->hasSymbols())
+            {
+                const std::vector < unsigned int >&s = (*pe)->getSymbolIds();
+
+                snprintf(num, sizeof(num), "%s%u symbols",
+                    labeled ? "\\n" : "", (*pe)->getSymbolCount());
+                buf += num;
+
+                for (size_t i = 0; i < s.size(); i++)
+                {
+                    buf += "\\n";
+                    buf += strings.get(s[i]);
+                }
+            }
+
+            buf += "\"";
+        }
+
+        if ((*pe)->getLoadOrder() > 0)
+        {
+            dot_attribute(buf, open);
+            snprintf(num, sizeof(num), "headlabel=\"%d\"",
+                (*pe)->getLoadOrder());
+            buf += num;
+        }
+
+        // the edge of the dominator tree, the one to cut
+        if ((*pe)->getTo()->getDominator() == (*pe)->getFrom())
+        {
+            dot_attribute(buf, open);
+            buf += "penwidth=2";
+        }
+
+        dot_end(buf, open);
+    }
+
+    // constrain output location of info block
+    if (edges.size() > 0)
+    {
+        ids.append(buf, edges[0]->getTo());
+        buf += " -> info_block [style=invis];\n";
+    }
+
+    // end digraph output
+    buf += "}\n";
+    out.write(buf.data(), buf.size());
+}
+
+// The binary graph format holds one record per graph, and records may be
+// concatenated. All numbers are 32 bit little endian. A record is
+//
+//   "LDDGRAPH", version, body size in bytes, then the body:
+//   string count, node count, edge count, label count, path string
+//   strings, each a byte count and the bytes
+//   node path strings, one per node
+//   edge offsets, one per node and one more: the edges from node i are
+//     edges offsets[i] up to offsets[i + 1], in their output order
+//   edge target nodes, one per edge
+//   label offsets, one per edge and one more, as for edge offsets
+//   label strings, one per label
+static const char graph_magic[] = "LDDGRAPH";
+
+enum
+{ GRAPH_VERSION = 1, GRAPH_HEADER_SIZE = 16 };
+
+static void put_u32(std::string & buf, unsigned int v)
+{
+    char b[4] = { (char)v, (char)(v >> 8), (char)(v >> 16), (char)(v >> 24) };
+
+    buf.append(b, sizeof(b));
+}
+
+// number the distinct strings of a graph record in order of first use
+class RecordStrings
+{
+ private:
+    std::map < unsigned int, unsigned int >index;       // global to record
+    std::vector < unsigned int >ids;
+
+ public:
+    unsigned int add(unsigned int id)
+    {
+        std::pair < std::map < unsigned int, unsigned int >::iterator,
+            bool > r = index.insert(std::make_pair(id, ids.size()));
+
+        if (r.second)
+        {
+            ids.push_back(id);
+        }
+
+        return r.first->second;
+    };
+
+    void write(std::string & buf)
+    {
+        for (size_t i = 0; i < ids.size(); i++)
+        {
+            const std::string & s = strings.get(ids[i]);
+
+            put_u32(buf, s.size());
+            buf += s;
+        }
+    };
+
+    size_t size(void)
+    {
+        return ids.size();
+    };
+
+    // the global id of string i
+    unsigned int get(size_t i)
+    {
+        return ids[i];
+    };
+};
+
+void write_binary(std::ostream & out, const std::string & path,
+    Nodes & nodes, Edges & edges)
+{
+    RecordStrings strs;
+    std::map < Node *, unsigned int >node_index;
+    std::vector < unsigned int >node_strs;
+
+    unsigned int path_str = strs.add(strings.intern(path));
+
+    for (Nodes::iterator pn = nodes.begin(); pn != nodes.end(); ++pn)
+    {
+        node_index[*pn] = node_strs.size();
+        node_strs.push_back(strs.add((*pn)->getPathId()));
+    }
+
+    // bucket the edges by source node, keeping their order within each
+    std::vector < std::vector < Edge * > >from(nodes.size());
+    size_t label_count = 0;
+
+    for (Edges::iterator pe = edges.begin(); pe != edges.end(); ++pe)
+    {
+        std::map < Node *, unsigned int >::iterator pf =
+            node_index.find((*pe)->getFrom());
+
+        if (pf == node_index.end() ||
+            node_index.find((*pe)->getTo()) == node_index.end())
+        {
+            continue;
+        }
+
+        from[pf->second].push_back(*pe);
+        label_count += (*pe)->getLabelIds().size();
+    }
+
+    std::string offsets, targets, label_offsets, labels;
+    unsigned int edge_count = 0;
+
+    label_count = 0;
+
+    for (size_t i = 0; i < from.size(); i++)
+    {
+        put_u32(offsets, edge_count);
+
+        for (size_t j = 0; j < from[i].size(); j++, edge_count++)
+        {
+            const std::vector < unsigned int >&l = from[i][j]->getLabelIds();
+
+            put_u32(targets, node_index[from[i][j]->getTo()]);
+            put_u32(label_offsets, label_count);
+
+            for (size_t k = 0; k < l.size(); k++, label_count++)
+            {
+                put_u32(labels, strs.add(l[k]));
+            }
+        }
+    }
+
+    put_u32(offsets, edge_count);
+    put_u32(label_offsets, label_count);
+
+    std::string body;
+
+    put_u32(body, strs.size());
+    put_u32(body, node_strs.size());
+    put_u32(body, edge_count);
+    put_u32(body, label_count);
+    put_u32(body, path_str);
+    strs.write(body);
+
+    for (size_t i = 0; i < node_strs.size(); i++)
+    {
+        put_u32(body, node_strs[i]);
+    }
+
+    body += offsets;
+    body += targets;
+    body += label_offsets;
+    body += labels;
+
+    std::string header(graph_magic, sizeof(graph_magic) - 1);
+
+    put_u32(header, GRAPH_VERSION);
+    put_u32(header, body.size());
+
+    out.write(header.data(), header.size());
+    out.write(body.data(), body.size());
+}
+
+// append s to buf as a JSON string
+static void append_json(std::string & buf, const std::string & s)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    buf += '"';
+
+    for (size_t i = 0; i < s.size(); i++)
+    {
+        unsigned char c = s[i];
+
+        if (c == '"' || c == '\\')
+        {
+            buf += '\\';
+            buf += c;
+        }
+        else if (c < 0x20)
+        {
+            buf += "\\u00";
+            buf += hex[c >> 4];
+            buf += hex[c & 0xf];
+        }
+        else
+        {
+            buf += c;
+        }
+    }
+
+    buf += '"';
+}
+
+// write a graph as one line of JSON:
+// {"file": path, "nodes": [path, ...], "edges": [{"from": path,
+// "to": path, "strong": bool, "labels": [label, ...]}, ...]}
+// with symbol binding, edges also have "symbols": count, "unused": bool
+// and "symbol_names": [name, ...]; with dominators, "dominators" lists
+// {"path": path, "idom": path or null, "dominates": count, "weight":
+// load cost weight of the node and those it dominates}
+void write_json(std::ostream & out, const std::string & path, Nodes & nodes,
+    Edges & edges)
+{
+    std::string buf;
+
+    buf.reserve(64 * (nodes.size() + edges.size()) + 64);
+    buf += "{\"file\": ";
+    append_json(buf, path);
+    buf += ", \"nodes\": [";
+
+    for (Nodes::iterator pn = nodes.begin(); pn != nodes.end(); ++pn)
+    {
+        if (pn != nodes.begin())
+        {
+            buf += ", ";
+        }
+
+        append_json(buf, (*pn)->getPath());
+    }
+
+    buf += "]";
+
+    // load costs of the nodes they were measured for
+    bool first = true;
+
+    for (Nodes::iterator pn = nodes.begin(); pn != nodes.end(); ++pn)
+    {
+        const LoadCost & c = (*pn)->getCost();
+        char figures[256];
+
+        if (!c.measured)
+        {
+            continue;
+        }
+
+        buf += first ? ", \"costs\": [{\"path\": " : ", {\"path\": ";
+        append_json(buf, (*pn)->getPath());
+        snprintf(figures, sizeof(figures), ", \"relative\": %llu, "
+            "\"symbolic\": %llu, \"plt\": %llu, \"lookups\": %llu, "
+            "\"bind_now\": %s, \"prelinked\": %s, \"load_size\": %llu}",
+            (unsigned long long)c.relative, (unsigned long long)c.symbolic,
+            (unsigned long long)c.plt, (unsigned long long)c.lookups,
+            c.bind_now ? "true" : "false", c.prelinked ? "true" : "false",
+            (unsigned long long)c.load_size);
+        buf += figures;
+        first = false;
+    }
+
+    buf += first ? "" : "]";
+
+    // dominators, where they were found
+    first = true;
+
+    for (Nodes::iterator pn = nodes.begin(); pn != nodes.end(); ++pn)
+    {
+        char figures[64];
+
+        if (!(*pn)->hasDominance())
+        {
+            continue;
+        }
+
+        buf += first ? ", \"dominators\": [{\"path\": " : ", {\"path\": ";
+        append_json(buf, (*pn)->getPath());
+        buf += ", \"idom\": ";
+
+        if ((*pn)->getDominator() != NULL)
+        {
+            append_json(buf, (*pn)->getDominator()->getPath());
+        }
+        else
+        {
+            buf += "null";
+        }
+
+        snprintf(figures, sizeof(figures), ", \"dominates\": %u, "
+            "\"weight\": %llu}", (*pn)->getDominated(),
+            (unsigned long long)(*pn)->getDominatedWeight());
+        buf += figures;
+        first = false;
+    }
+
+    buf += first ? "" : "]";
+
+    // measured startup, and the objects in the order they were loaded
+    const StartupProfile & p = nodes.size() > 0 ? nodes[0]->getProfile() :
+        StartupProfile();
+
+    if (p.runs > 0)
+    {
+        char figures[512];
+        std::vector < Node * >order;
+
+        snprintf(figures, sizeof(figures), ", \"profile\": {\"runs\": %u, "
+            "\"startup_min\": %llu, \"startup_mean\": %llu, "
+            "\"relocation_min\": %llu, \"relocation_mean\": %llu, "
+            "\"load_min\": %llu, \"load_mean\": %llu, "
+            "\"relocations\": %llu, \"relative\": %llu}", p.runs,
+            (unsigned long long)p.startup_min,
+            (unsigned long long)(p.startup_sum / p.runs),
+            (unsigned long long)p.relocation_min,
+            (unsigned long long)(p.relocation_sum / p.runs),
+            (unsigned long long)p.load_min,
+            (unsigned long long)(p.load_sum / p.runs),
+            (unsigned long long)p.relocations, (unsigned long long)p.relative);
+        buf += figures;
+
+        for (Nodes::iterator pn = nodes.begin(); pn != nodes.end(); ++pn)
+        {
+            int o = (*pn)->getLoadOrder();
+
+            if (o >= 0)
+            {
+                if ((size_t) o >= order.size())
+                {
+                    order.resize(o + 1);
+                }
+
+                order[o] = *pn;
+            }
+        }
+
+        buf += ", \"load_order\": [";
+
+        for (size_t i = 0, n = 0; i < order.size(); i++)
+        {
+            if (order[i] != NULL)
+            {
+                buf += n++ > 0 ? ", " : "";
+                append_json(buf, order[i]->getPath());
+            }
+        }
+
+        buf += "]";
+    }
+
+    buf += ", \"edges\": [";
+
+    for (Edges::iterator pe = edges.begin(); pe != edges.end(); ++pe)
+    {
+        const std::vector < unsigned int >&labels = (*pe)->getLabelIds();
+
+        if (pe != edges.begin())
+        {
+            buf += ", ";
+        }
+
+        buf += "{\"from\": ";
+        append_json(buf, (*pe)->getFrom()->getPath());
+        buf += ", \"to\": ";
+        append_json(buf, (*pe)->getTo()->getPath());
+        buf += (*pe)->isLabeled()? ", \"strong\": true" : ", \"strong\": false";
+        buf += ", \"labels\": [";
+
+        for (size_t i = 0; i < labels.size(); i++)
+        {
+            if (i > 0)
+            {
+                buf += ", ";
+            }
+
+            append_json(buf, strings.get(labels[i]));
+        }
+
+        buf += "]";
+
+        if ((*pe)->hasSymbols())
+        {
+            const std::vector < unsigned int >&s = (*pe)->getSymbolIds();
+            char count[16];
+
+            snprintf(count, sizeof(count), "%u", (*pe)->getSymbolCount());
+            buf += ", \"symbols\": ";
+            buf += count;
+            buf += (*pe)->isUnused()? ", \"unused\": true" :
+                ", \"unused\": false";
+            buf += ", \"symbol_names\": [";
+
+            for (size_t i = 0; i < s.size(); i++)
+            {
+                if (i > 0)
+                {
+                    buf += ", ";
+                }
+
+                append_json(buf, strings.get(s[i]));
+            }
+
+            buf += "]";
+        }
+
+        buf += "}";
+    }
+
+    buf += "]}\n";
+    out.write(buf.data(), buf.size());
+}
+
+// write a graph as tab separated edges, one per line:
+// path, from, to, "strong" or "weak", comma separated labels, and with
+// symbol binding the count of the symbols bound across the edge
+void write_tsv(std::ostream & out, const std::string & path, Edges & edges)
+{
+    std::string buf;
+
+    buf.reserve(128 * edges.size());
+
+    for (Edges::iterator pe = edges.begin(); pe != edges.end(); ++pe)
+    {
+        buf += path;
+        buf += '\t';
+        buf += (*pe)->getFrom()->getPath();
+        buf += '\t';
+        buf += (*pe)->getTo()->getPath();
+        buf += (*pe)->isLabeled()? "\tstrong\t" : "\tweak\t";
+        buf += (*pe)->getLabels(",");
+
+        if ((*pe)->hasSymbols())
+        {
+            char count[16];
+
+            snprintf(count, sizeof(count), "\t%u", (*pe)->getSymbolCount());
+            buf += count;
+        }
+
+        buf += '\n';
+    }
+
+    out.write(buf.data(), buf.size());
+}
+
+// emit a graph in the selected output format
+void print_graph(std::ostream & out, Format format, std::string & path,
+    std::string info, Nodes & nodes, Edges & edges)
+{
+    switch (format)
+    {
+        case FORMAT_BINARY:
+            write_binary(out, path, nodes, edges);
+            break;
+        case FORMAT_JSON:
+            write_json(out, path, nodes, edges);
+            break;
+        case FORMAT_TSV:
+            write_tsv(out, path, edges);
+            break;
+        default:
+            print_output(out, info, nodes, edges);
+    }
+}
+
+/*************************
+ *  Diff
+ *************************/
+
+// Baseline keeps the graphs of an earlier run, by root path, for the
+// graphs of this run to be compared against
+class Baseline:public GraphSink
+{
+ private:
+    std::map < std::string, Document * >docs;
+
+    Baseline(const Baseline &);
+    Baseline & operator =(const Baseline &);
+
+ public:
+    Baseline()
+    {
+    };
+
+    ~Baseline()
+    {
+        for (std::map < std::string, Document * >::iterator pd = docs.begin();
+            pd != docs.end(); ++pd)
+        {
+            delete pd->second;
+        }
+    };
+
+    // keep a graph, replacing any earlier graph of the same root
+    void add(std::string & path, Nodes & nodes, Edges & edges)
+    {
+        Document *&doc = docs[path];
+
+        delete doc;
+        doc = new Document;
+        doc->path = path;
+        doc->nodes.swap(nodes);
+        doc->edges.swap(edges);
+    };
+
+    // the earlier graph of a root, or NULL if it had none
+    Document *find(const std::string & path) const
+    {
+        std::map < std::string, Document * >::const_iterator pd =
+            docs.find(path);
+
+        return pd != docs.end() ? pd->second : NULL;
+    };
+};
+
+// GraphDelta is what changed between an earlier and a later graph of a
+// root. Nodes are matched by path and edges by the paths of their ends;
+// an edge in both graphs whose labels differ is changed.
+struct GraphDelta
+{
+    std::vector < Node * >added_nodes;
+    std::vector < Node * >removed_nodes;        // of the earlier graph
+    std::vector < Edge * >added_edges;
+    std::vector < Edge * >removed_edges;        // of the earlier graph
+    std::vector < Edge * >changed_edges;
+    std::vector < std::vector < unsigned int > > added_labels;
+    std::vector < std::vector < unsigned int > > removed_labels;
+
+    typedef std::pair < unsigned int, unsigned int > EdgeKey;
+
+    static EdgeKey key(Edge * e)
+    {
+        return std::make_pair(e->getFrom()->getPathId(),
+            e->getTo()->getPathId());
+    };
+
+    // the labels of a that b lacks
+    static std::vector < unsigned int > missing(Edge * a, Edge * b)
+    {
+        const std::vector < unsigned int >&la = a->getLabelIds();
+        const std::vector < unsigned int >&lb = b->getLabelIds();
+        std::vector < unsigned int > m;
+
+        for (size_t i = 0; i < la.size(); i++)
+        {
+            if (std::find(lb.begin(), lb.end(), la[i]) == lb.end())
+            {
+                m.push_back(la[i]);
+            }
+        }
+
+        return m;
+    };
+
+    GraphDelta(Nodes & before_nodes, Edges & before_edges,
+        Nodes & after_nodes, Edges & after_edges)
+    {
+        std::map < unsigned int, Node * >before;
+        std::map < unsigned int, Node * >after;
+
+        for (Nodes::iterator pn = before_nodes.begin();
+            pn != before_nodes.end(); ++pn)
+        {
+            before.insert(std::make_pair((*pn)->getPathId(), *pn));
+        }
+
+        for (Nodes::iterator pn = after_nodes.begin();
+            pn != after_nodes.end(); ++pn)
+        {
+            after.insert(std::make_pair((*pn)->getPathId(), *pn));
+
+            if (before.find((*pn)->getPathId()) == before.end())
+            {
+                added_nodes.push_back(*pn);
+            }
+        }
+
+        for (Nodes::iterator pn = before_nodes.begin();
+            pn != before_nodes.end(); ++pn)
+        {
+            if (after.find((*pn)->getPathId()) == after.end())
+            {
+                removed_nodes.push_back(*pn);
+            }
+        }
+
+        std::map < EdgeKey, Edge * >before_index;
+        std::map < EdgeKey, Edge * >after_index;
+
+        for (Edges::iterator pe = before_edges.begin();
+            pe != before_edges.end(); ++pe)
+        {
+            before_index.insert(std::make_pair(key(*pe), *pe));
+        }
+
+        for (Edges::iterator pe = after_edges.begin();
+            pe != after_edges.end(); ++pe)
+        {
+            after_index.insert(std::make_pair(key(*pe), *pe));
+
+            std::map < EdgeKey, Edge * >::iterator pb =
+                before_index.find(key(*pe));
+
+            if (pb == before_index.end())
+            {
+                added_edges.push_back(*pe);
+                continue;
+            }
+
+            std::vector < unsigned int > added = missing(*pe, pb->second);
+            std::vector < unsigned int > removed = missing(pb->second, *pe);
+
+            if (!added.empty() || !removed.empty())
+            {
+                changed_edges.push_back(*pe);
+                added_labels.push_back(added);
+                removed_labels.push_back(removed);
+            }
+        }
+
+        for (Edges::iterator pe = before_edges.begin();
+            pe != before_edges.end(); ++pe)
+        {
+            if (after_index.find(key(*pe)) == after_index.end())
+            {
+                removed_edges.push_back(*pe);
+            }
+        }
+    };
+
+    bool empty(void) const
+    {
+        return added_nodes.empty() && removed_nodes.empty() &&
+            added_edges.empty() && removed_edges.empty() &&
+            changed_edges.empty();
+    };
+
+    static size_t count(const std::vector < std::vector < unsigned int > >&l)
+    {
+        size_t n = 0;
+
+        for (size_t i = 0; i < l.size(); i++)
+        {
+            n += l[i].size();
+        }
+
+        return n;
+    };
+};
+
+// append interned labels, prefixing each
+static void append_labels(std::string & buf,
+    const std::vector < unsigned int >&labels, const char *prefix,
+    const char *delimiter)
+{
+    for (size_t i = 0; i < labels.size(); i++)
+    {
+        buf += i > 0 ? delimiter : "";
+        buf += prefix;
+        buf += strings.get(labels[i]);
+    }
+}
+
+// describe the changes to a root's graph for the info block
+static std::string delta_label(const std::string & path,
+    const GraphDelta & d)
+{
+    std::ostringstream s;
+
+    s << "file: " << path <<
+        "\\nadded: " << d.added_nodes.size() << " nodes, " <<
+        d.added_edges.size() << " edges, " <<
+        GraphDelta::count(d.added_labels) << " labels" <<
+        "\\nremoved: " << d.removed_nodes.size() << " nodes, " <<
+        d.removed_edges.size() << " edges, " <<
+        GraphDelta::count(d.removed_labels) << " labels";
+
+    return s.str();
+}
+
+// write the changes as a DOT graph: added nodes and edges in green,
+// removed ones dashed in red, and edges whose labels changed in blue
+// labeled with the labels added (+) and removed (-). The unchanged ends
+// of changed edges are drawn plain. As in print_output, the graph is
+// built in one buffer and written at once.
+static void write_delta_dot(std::ostream & out, const std::string & path,
+    GraphDelta & d)
+{
+    std::string buf;
+    std::map < unsigned int, const char * >nodes;       // by path, color
+    std::vector < Node * >order;
+
+    buf += "digraph G {\n";
+    buf += "info_block [shape=box, label=\"";
+    buf += delta_label(path, d);
+    buf += "\"];\n";
+
+    for (size_t i = 0; i < d.added_nodes.size(); i++)
+    {
+        nodes[d.added_nodes[i]->getPathId()] = "green3";
+        order.push_back(d.added_nodes[i]);
+    }
+
+    for (size_t i = 0; i < d.removed_nodes.size(); i++)
+    {
+        nodes[d.removed_nodes[i]->getPathId()] = "red";
+        order.push_back(d.removed_nodes[i]);
+    }
+
+    std::vector < Edge * >edges(d.added_edges);
+
+    edges.insert(edges.end(), d.removed_edges.begin(), d.removed_edges.end());
+    edges.insert(edges.end(), d.changed_edges.begin(), d.changed_edges.end());
+
+    for (size_t i = 0; i < edges.size(); i++)
+    {
+        Node *ends[2] = { edges[i]->getFrom(), edges[i]->getTo() };
+
+        for (int j = 0; j < 2; j++)
+        {
+            if (nodes.insert(std::make_pair(ends[j]->getPathId(),
+                        (const char *)NULL)).second)
+            {
+                order.push_back(ends[j]);
+            }
+        }
+    }
+
+    buf.reserve(buf.size() + 64 * order.size() + 160 * edges.size() + 64);
+
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        const char *color = nodes[order[i]->getPathId()];
+        bool open = false;
+
+        order[i]->appendPathQuoted(buf);
+
+        if (color != NULL)
+        {
+            dot_attribute(buf, open);
+            buf += "color=";
+            buf += color;
+            dot_attribute(buf, open);
+            buf += "fontcolor=";
+            buf += color;
+        }
+
+        if (color != NULL && strcmp(color, "red") == 0)
+        {
+            dot_attribute(buf, open);
+            buf += "style=dashed";
+        }
+
+        dot_end(buf, open);
+    }
+
+    size_t added = d.added_edges.size();
+    size_t removed = d.removed_edges.size();
+
+    for (size_t i = 0; i < edges.size(); i++)
+    {
+        Edge *e = edges[i];
+        bool open = true;
+
+        e->getFrom()->appendPathQuoted(buf);
+        buf += " -> ";
+        e->getTo()->appendPathQuoted(buf);
+
+        if (i < added)
+        {
+            buf += " [color=green3, ";
+            buf += e->isLabeled()? "style=solid" : "style=dotted";
+
+            if (e->isLabeled())
+            {
+                buf += ", label=\"";
+                e->appendLabels(buf, "\\n");
+                buf += "\"";
+            }
+        }
+        else if (i < added + removed)
+        {
+            buf += " [color=red, style=dashed";
+
+            if (e->isLabeled())
+            {
+                buf += ", label=\"";
+                e->appendLabels(buf, "\\n");
+                buf += "\"";
+            }
+        }
+        else
+        {
+            size_t c = i - added - removed;
+            const std::vector < unsigned int >&plus = d.added_labels[c];
+            const std::vector < unsigned int >&minus = d.removed_labels[c];
+
+            buf += " [color=blue, ";
+            buf += e->isLabeled()? "style=solid" : "style=dotted";
+
+            if (!plus.empty() || !minus.empty())
+            {
+                buf += ", label=\"";
+                append_labels(buf, plus, "+", "\\n");
+                buf += !plus.empty() && !minus.empty() ? "\\n" : "";
+                append_labels(buf, minus, "-", "\\n");
+                buf += "\"";
+            }
+        }
+
+        dot_end(buf, open);
+    }
+
+    // constrain output location of info block
+    if (!order.empty())
+    {
+        order[0]->appendPathQuoted(buf);
+        buf += " -> info_block [style=invis];\n";
+    }
+
+    buf += "}\n";
+    out.write(buf.data(), buf.size());
+}
+
+// append JSON edges as {"from": path, "to": path, "strong": bool,
+// "labels": [label, ...]}, with the labels given or those of each edge
+static void append_delta_edges(std::string & buf,
+    const std::vector < Edge * >&edges,
+    const std::vector < std::vector < unsigned int > >*labels)
+{
+    for (size_t i = 0; i < edges.size(); i++)
+    {
+        const std::vector < unsigned int >&l = labels != NULL ?
+            (*labels)[i] : edges[i]->getLabelIds();
+
+        buf += i > 0 ? ", {\"from\": " : "{\"from\": ";
+        append_json(buf, edges[i]->getFrom()->getPath());
+        buf += ", \"to\": ";
+        append_json(buf, edges[i]->getTo()->getPath());
+        buf += edges[i]->isLabeled()? ", \"strong\": true" :
+            ", \"strong\": false";
+        buf += ", \"labels\": [";
+
+        for (size_t j = 0; j < l.size(); j++)
+        {
+            buf += j > 0 ? ", " : "";
+            append_json(buf, strings.get(l[j]));
+        }
+
+        buf += "]}";
+    }
+}
+
+// write the changes as one line of JSON:
+// {"file": path, "added": changes, "removed": changes} where changes are
+// {"nodes": [path, ...], "edges": [edge, ...], "labels": [edge, ...]}:
+// the nodes and edges added or removed, and the edges in both graphs
+// listing just the labels added or removed
+static void write_delta_json(std::ostream & out, const std::string & path,
+    GraphDelta & d)
+{
+    std::string buf;
+
+    buf += "{\"file\": ";
+    append_json(buf, path);
+
+    for (int side = 0; side < 2; side++)
+    {
+        std::vector < Node * >&nodes = side == 0 ? d.added_nodes :
+            d.removed_nodes;
+
+        buf += side == 0 ? ", \"added\": {\"nodes\": [" :
+            ", \"removed\": {\"nodes\": [";
+
+        for (size_t i = 0; i < nodes.size(); i++)
+        {
+            buf += i > 0 ? ", " : "";
+            append_json(buf, nodes[i]->getPath());
+        }
+
+        buf += "], \"edges\": [";
+        append_delta_edges(buf, side == 0 ? d.added_edges : d.removed_edges,
+            NULL);
+        buf += "], \"labels\": [";
+        append_delta_edges(buf, d.changed_edges,
+            side == 0 ? &d.added_labels : &d.removed_labels);
+        buf += "]}";
+    }
+
+    buf += "}\n";
+    out.write(buf.data(), buf.size());
+}
+
+// write the changes as tab separated lines, each starting with the path
+// and "added" or "removed", then one of
+//   node, path
+//   edge, from, to, "strong" or "weak", comma separated labels
+//   labels, from, to, comma separated labels added or removed
+static void write_delta_tsv(std::ostream & out, const std::string & path,
+    GraphDelta & d)
+{
+    std::string buf;
+
+    for (int side = 0; side < 2; side++)
+    {
+        std::string head(path + (side == 0 ? "\tadded\t" : "\tremoved\t"));
+        std::vector < Node * >&nodes = side == 0 ? d.added_nodes :
+            d.removed_nodes;
+        std::vector < Edge * >&edges = side == 0 ? d.added_edges :
+            d.removed_edges;
+        std::vector < std::vector < unsigned int > >&labels = side == 0 ?
+            d.added_labels : d.removed_labels;
+
+        for (size_t i = 0; i < nodes.size(); i++)
+        {
+            buf += head + "node\t" + nodes[i]->getPath() + "\n";
+        }
+
+        for (size_t i = 0; i < edges.size(); i++)
+        {
+            buf += head + "edge\t" + edges[i]->getFrom()->getPath() + "\t" +
+                edges[i]->getTo()->getPath() +
+                (edges[i]->isLabeled()? "\tstrong\t" : "\tweak\t") +
+                edges[i]->getLabels(",") + "\n";
+        }
+
+        for (size_t i = 0; i < d.changed_edges.size(); i++)
+        {
+            if (!labels[i].empty())
+            {
+                buf += head + "labels\t" +
+                    d.changed_edges[i]->getFrom()->getPath() + "\t" +
+                    d.changed_edges[i]->getTo()->getPath() + "\t";
+                append_labels(buf, labels[i], "", ",");
+                buf += "\n";
+            }
+        }
+    }
+
+    out.write(buf.data(), buf.size());
+}
+
+// DiffSink emits what changed in each graph since the baseline, and
+// nothing for a graph that is unchanged. A root the baseline lacks is
+// compared with an empty graph.
+class DiffSink:public GraphSink
+{
+ private:
+    std::ostream & out;
+    Format format;
+    const Baseline *baseline;
+
+ public:
+    DiffSink(std::ostream & o, Format f, const Baseline * b):out(o),
+        format(f), baseline(b)
+    {
+    };
+
+    void add(std::string & path, Nodes & nodes, Edges & edges)
+    {
+        Nodes no_nodes;
+        Edges no_edges;
+        Document *doc = baseline->find(path);
+        GraphDelta delta(doc != NULL ? doc->nodes : no_nodes,
+            doc != NULL ? doc->edges : no_edges, nodes, edges);
+
+        if (delta.empty())
+        {
+            return;
+        }
+
+        switch (format)
+        {
+            case FORMAT_JSON:
+                write_delta_json(out, path, delta);
+                break;
+            case FORMAT_TSV:
+                write_delta_tsv(out, path, delta);
+                break;
+            default:
+                write_delta_dot(out, path, delta);
+        }
+    };
+};
+
+/*************************
+ *  Reverse index
+ *************************/
+
+// The reverse index file maps each object, by path and by file name, and
+// each version label, to the objects needing it directly and to the roots
+// whose graphs load it. All numbers are 32 bit little endian:
+//
+//   "LDDINDEX", version, body size in bytes, then the body:
+//   key count, string count
+//   string offsets, one per string and one more, into the string bytes
+//   direct offsets, one per key and one more: the objects needing key i
+//     are direct strings offsets[i] up to offsets[i + 1]
+//   direct strings
+//   root offsets, one per key and one more, as for direct offsets
+//   root strings
+//   string bytes
+//
+// The keys are the first strings, in sorted order, so a query is a binary
+// search of the mapped file.
+enum
+{ INDEX_VERSION = 1, INDEX_HEADER_SIZE = 16 };
+static const char index_magic[] = "LDDINDEX";
+
+// ReverseIndex gathers, from each graph, the objects and version labels
+// each object and root depends on, passing the graph on to next if there
+// is one
+class ReverseIndex:public GraphSink
+{
+ private:
+    struct Entry
+    {
+        std::set < unsigned int > direct;      // objects needing it
+        std::set < unsigned int > roots;       // roots loading it
+    };
+
+    std::map < unsigned int, Entry > entries;  // by interned key
+    GraphSink *next;
+
+    // note that root loads the object at path, or that from needs it
+    // directly, under its path and its file name
+    void add_object(const std::string & path, bool is_direct,
+        unsigned int id)
+    {
+        size_t slash = path.rfind('/');
+        Entry & e = entries[strings.intern(path)];
+
+        (is_direct ? e.direct : e.roots).insert(id);
+
+        if (slash != std::string::npos && slash + 1 < path.size())
+        {
+            Entry & b = entries[strings.intern(path.substr(slash + 1))];
+
+            (is_direct ? b.direct : b.roots).insert(id);
+        }
+    };
+
+    // strings of a set in sorted order
+    static std::vector < unsigned int > sorted(const std::set < unsigned int >&s)
+    {
+        std::vector < std::pair < std::string, unsigned int > > v;
+        std::vector < unsigned int > ids;
+
+        for (std::set < unsigned int >::const_iterator ps = s.begin();
+            ps != s.end(); ++ps)
+        {
+            v.push_back(std::make_pair(strings.get(*ps), *ps));
+        }
+
+        std::sort(v.begin(), v.end());
+
+        for (size_t i = 0; i < v.size(); i++)
+        {
+            ids.push_back(v[i].second);
+        }
+
+        return ids;
+    };
+
+ public:
+    ReverseIndex(GraphSink * n)
+    {
+        next = n;
+    };
+
+    void add(std::string & path, Nodes & nodes, Edges & edges)
+    {
+        unsigned int root = strings.intern(path);
+
+        // the graph of a root holds every object it loads
+        for (Nodes::iterator pn = nodes.begin(); pn != nodes.end(); ++pn)
+        {
+            if (pn != nodes.begin())
+            {
+                add_object((*pn)->getPath(), false, root);
+            }
+        }
+
+        for (Edges::iterator pe = edges.begin(); pe != edges.end(); ++pe)
+        {
+            unsigned int from = (*pe)->getFrom()->getPathId();
+            const std::vector < unsigned int >&l = (*pe)->getLabelIds();
+
+            add_object((*pe)->getTo()->getPath(), true, from);
+
+            for (size_t i = 0; i < l.size(); i++)
+            {
+                entries[l[i]].direct.insert(from);
+                entries[l[i]].roots.insert(root);
+            }
+        }
+
+        if (next != NULL)
+        {
+            next->add(path, nodes, edges);
+        }
+    };
+
+    // write the index file, replacing it atomically
+    bool write(const std::string & file)
+    {
+        std::vector < std::pair < std::string, unsigned int > > keys;
+
+        for (std::map < unsigned int, Entry >::iterator pe = entries.begin();
+            pe != entries.end(); ++pe)
+        {
+            keys.push_back(std::make_pair(strings.get(pe->first), pe->first));
+        }
+
+        std::sort(keys.begin(), keys.end());
+
+        // the keys are numbered first, in order
+        RecordStrings strs;
+        std::string direct_offsets, direct, root_offsets, roots;
+        unsigned int ndirect = 0, nroots = 0;
+
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            strs.add(keys[i].second);
+        }
+
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            Entry & e = entries[keys[i].second];
+            std::vector < unsigned int > d = sorted(e.direct);
+            std::vector < unsigned int > r = sorted(e.roots);
+
+            put_u32(direct_offsets, ndirect);
+            put_u32(root_offsets, nroots);
+
+            for (size_t j = 0; j < d.size(); j++)
+            {
+                put_u32(direct, strs.add(d[j]));
+            }
+
+            for (size_t j = 0; j < r.size(); j++)
+            {
+                put_u32(roots, strs.add(r[j]));
+            }
+
+            ndirect += d.size();
+            nroots += r.size();
+        }
+
+        put_u32(direct_offsets, ndirect);
+        put_u32(root_offsets, nroots);
+
+        std::string body, offsets, bytes;
+
+        for (size_t i = 0; i < strs.size(); i++)
+        {
+            put_u32(offsets, bytes.size());
+            bytes += strings.get(strs.get(i));
+        }
+
+        put_u32(offsets, bytes.size());
+        put_u32(body, keys.size());
+        put_u32(body, strs.size());
+        body += offsets + direct_offsets + direct + root_offsets + roots + bytes;
+
+        std::string header(index_magic, sizeof(index_magic) - 1);
+
+        put_u32(header, INDEX_VERSION);
+        put_u32(header, body.size());
+
+        std::string tmp(file + ".tmp");
+        std::ofstream out(tmp.c_str());
+
+        out << header << body;
+        out.close();
+
+        if (!out || rename(tmp.c_str(), file.c_str()) != 0)
+        {
+            std::cerr << file << ": cannot write index: " << strerror(errno) <<
+                std::endl;
+            unlink(tmp.c_str());
+            return false;
+        }
+
+        return true;
+    };
+};
+
+// IndexFile answers queries from a mapped reverse index file
+class IndexFile
+{
+ private:
+    const unsigned char *data;
+    size_t size;
+    unsigned int keys;
+    unsigned int strs;
+    size_t string_offsets;      // file offsets of the arrays
+    size_t direct_offsets;
+    size_t direct;
+    size_t root_offsets;
+    size_t roots;
+    size_t bytes;
+
+    IndexFile(const IndexFile &);
+    IndexFile & operator =(const IndexFile &);
+
+    unsigned int u32(size_t pos) const
+    {
+        const unsigned char *p = data + pos;
+
+        return p[0] | p[1] << 8 | p[2] << 16 | (unsigned int)p[3] << 24;
+    };
+
+    // u32 i of the array at pos
+    unsigned int at(size_t pos, size_t i) const
+    {
+        return u32(pos + 4 * i);
+    };
+
+    std::string str(unsigned int i) const
+    {
+        size_t start = at(string_offsets, i);
+
+        return std::string((const char *)data + bytes + start,
+            at(string_offsets, i + 1) - start);
+    };
+
+    // an offsets array of count + 1 ascending entries, the last of them
+    // the count of the list following it, all bounded by limit
+    bool check_offsets(size_t pos, unsigned int count, size_t limit)
+    {
+        for (unsigned int i = 0; i < count; i++)
+        {
+            if (at(pos, i) > at(pos, i + 1))
+            {
+                return false;
+            }
+        }
+
+        return at(pos, count) <= limit;
+    };
+
+    // check the arrays fit the body and index within it
+    bool check(size_t body_size)
+    {
+        size_t pos = INDEX_HEADER_SIZE;
+        size_t end = pos + body_size;
+
+        if (body_size < 8)
+        {
+            return false;
+        }
+
+        keys = u32(pos);
+        strs = u32(pos + 4);
+        pos += 8;
+
+        if (keys > strs || (size_t)strs + 1 > (end - pos) / 4)
+        {
+            return false;
+        }
+
+        string_offsets = pos;
+        pos += 4 * ((size_t)strs + 1);
+
+        // each of the direct and root sections
+        size_t *sections[2][2] = { {&direct_offsets, &direct},
+        {&root_offsets, &roots}
+        };
+
+        for (int s = 0; s < 2; s++)
+        {
+            if ((end - pos) / 4 < (size_t)keys + 1)
+            {
+                return false;
+            }
+
+            *sections[s][0] = pos;
+            pos += 4 * ((size_t)keys + 1);
+
+            unsigned int n = at(*sections[s][0], keys);
+
+            if (!check_offsets(*sections[s][0], keys, (end - pos) / 4))
+            {
+                return false;
+            }
+
+            *sections[s][1] = pos;
+
+            for (unsigned int i = 0; i < n; i++)
+            {
+                if (at(pos, i) >= strs)
+                {
+                    return false;
+                }
+            }
+
+            pos += 4 * (size_t)n;
+        }
+
+        bytes = pos;
+
+        return check_offsets(string_offsets, strs, end - pos);
+    };
+
+    // the strings of entries first up to last of the list at pos
+    void list(size_t pos, unsigned int first, unsigned int last,
+        std::vector < std::string > &v) const
+    {
+        for (unsigned int i = first; i < last; i++)
+        {
+            v.push_back(str(at(pos, i)));
+        }
+    };
+
+ public:
+    IndexFile()
+    {
+        data = NULL;
+        size = 0;
+    };
+
+    ~IndexFile()
+    {
+        if (data != NULL)
+        {
+            munmap((void *)data, size);
+        }
+    };
+
+    // map the index file, false if it cannot be read or is malformed
+    bool open(const std::string & path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        struct stat st;
+
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+            (size_t)st.st_size >= INDEX_HEADER_SIZE)
+        {
+            void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (map != MAP_FAILED)
+            {
+                data = (const unsigned char *)map;
+                size = st.st_size;
+            }
+        }
+
+        ::close(fd);
+
+        return data != NULL &&
+            memcmp(data, index_magic, sizeof(index_magic) - 1) == 0 &&
+            u32(8) == INDEX_VERSION && u32(12) <= size - INDEX_HEADER_SIZE &&
+            check(u32(12));
+    };
+
+    // the objects needing name directly, and the roots loading it, false
+    // if the index does not hold it
+    bool find(const std::string & name, std::vector < std::string > &d,
+        std::vector < std::string > &r) const
+    {
+        unsigned int lo = 0, hi = keys;
+
+        while (lo < hi)
+        {
+            unsigned int mid = lo + (hi - lo) / 2;
+
+            if (str(mid) < name)
+            {
+                lo = mid + 1;
+            }
+            else
+            {
+                hi = mid;
+            }
+        }
+
+        if (lo == keys || str(lo) != name)
+        {
+            return false;
+        }
+
+        list(direct, at(direct_offsets, lo), at(direct_offsets, lo + 1), d);
+        list(roots, at(root_offsets, lo), at(root_offsets, lo + 1), r);
+
+        return true;
+    };
+};
+
+// answer each query from an index, as lines of name, "direct" or
+// "root", and path, or with json as a line per query of {"query": name,
+// "direct": [path, ...], "roots": [path, ...]}; false if some name is
+// not in the index
+static bool query_index(std::ostream & out, IndexFile & index,
+    const std::vector < std::string > &queries, Format format)
+{
+    bool found = true;
+
+    for (size_t i = 0; i < queries.size(); i++)
+    {
+        std::vector < std::string > d, r;
+        std::string buf;
+
+        if (!index.find(queries[i], d, r))
+        {
+            std::cerr << queries[i] << ": not in index" << std::endl;
+            found = false;
+            continue;
+        }
+
+        if (format == FORMAT_JSON)
+        {
+            buf += "{\"query\": ";
+            append_json(buf, queries[i]);
+
+            for (int s = 0; s < 2; s++)
+            {
+                std::vector < std::string > &v = s == 0 ? d : r;
+
+                buf += s == 0 ? ", \"direct\": [" : "], \"roots\": [";
+
+                for (size_t j = 0; j < v.size(); j++)
+                {
+                    buf += j > 0 ? ", " : "";
+                    append_json(buf, v[j]);
+                }
+            }
+
+            buf += "]}\n";
+        }
+        else
+        {
+            for (size_t j = 0; j < d.size(); j++)
+            {
+                buf += queries[i] + "\tdirect\t" + d[j] + "\n";
+            }
+
+            for (size_t j = 0; j < r.size(); j++)
+            {
+                buf += queries[i] + "\troot\t" + r[j] + "\n";
+            }
+        }
+
+        out.write(buf.data(), buf.size());
+    }
+
+    return found;
+}
+
+/*************************
+ *  Main helpers
+ *************************/
+
+// GraphFile reads the records of a binary graph file, as written by
+// write_binary, into nodes and edges
+class GraphFile
+{
+ private:
+    const unsigned char *data;
+    size_t size;
+    size_t pos;
+    bool bad;                   // a read went past the end
+
+    unsigned int u32(size_t limit)
+    {
+        if (limit < 4 || pos > limit - 4)
+        {
+            bad = true;
+            return 0;
+        }
+
+        const unsigned char *p = data + pos;
+
+        pos += 4;
+
+        return p[0] | p[1] << 8 | p[2] << 16 | (unsigned int)p[3] << 24;
+    };
+
+    // read count numbers each less than max, within the record ending at
+    // limit
+    bool u32s(std::vector < unsigned int >&v, unsigned int count,
+        unsigned int max, size_t limit)
+    {
+        if (count > (limit - pos) / 4)
+        {
+            return false;
+        }
+
+        v.resize(count);
+
+        for (unsigned int i = 0; i < count; i++)
+        {
+            v[i] = u32(limit);
+
+            if (v[i] >= max)
+            {
+                return false;
+            }
+        }
+
+        return !bad;
+    };
+
+    // read the record at pos, false if it is malformed
+    bool record(GraphSink & sink)
+    {
+        size_t magic_size = sizeof(graph_magic) - 1;
+
+        if (size - pos < GRAPH_HEADER_SIZE ||
+            memcmp(data + pos, graph_magic, magic_size) != 0)
+        {
+            return false;
+        }
+
+        pos += magic_size;
+
+        unsigned int version = u32(size);
+        size_t body_size = u32(size);
+
+        if (version != GRAPH_VERSION || body_size > size - pos)
+        {
+            return false;
+        }
+
+        size_t limit = pos + body_size;
+        unsigned int string_count = u32(limit);
+        unsigned int node_count = u32(limit);
+        unsigned int edge_count = u32(limit);
+        unsigned int label_count = u32(limit);
+        unsigned int path_str = u32(limit);
+
+        if (bad || string_count > body_size / 4 || path_str >= string_count)
+        {
+            return false;
+        }
+
+        std::vector < std::string > strs(string_count);
+
+        for (unsigned int i = 0; i < string_count; i++)
+        {
+            size_t n = u32(limit);
+
+            if (bad || n > limit - pos)
+            {
+                return false;
+            }
+
+            strs[i].assign((const char *)data + pos, n);
+            pos += n;
+        }
+
+        std::vector < unsigned int >node_strs, offsets, targets;
+        std::vector < unsigned int >label_offsets, labels;
+
+        if (!u32s(node_strs, node_count, string_count, limit) ||
+            !u32s(offsets, node_count + 1, edge_count + 1, limit) ||
+            !u32s(targets, edge_count, node_count, limit) ||
+            !u32s(label_offsets, edge_count + 1, label_count + 1, limit) ||
+            !u32s(labels, label_count, string_count, limit) ||
+            pos != limit)
+        {
+            return false;
+        }
+
+        Nodes nodes;
+        Edges edges;
+        std::vector < Node * >node(node_count);
+
+        for (unsigned int i = 0; i < node_count; i++)
+        {
+            node[i] = nodes.add(strs[node_strs[i]]);
+        }
+
+        for (unsigned int i = 0; i < node_count; i++)
+        {
+            if (offsets[i] > offsets[i + 1])
+            {
+                return false;
+            }
+
+            for (unsigned int e = offsets[i]; e < offsets[i + 1]; e++)
+            {
+                Edge *edge = edges.add(node[i], node[targets[e]]);
+
+                if (label_offsets[e] > label_offsets[e + 1])
+                {
+                    return false;
+                }
+
+                for (unsigned int l = label_offsets[e];
+                    l < label_offsets[e + 1]; l++)
+                {
+                    edge->addLabel(strs[labels[l]]);
+                }
+            }
+        }
+
+        sink.add(strs[path_str], nodes, edges);
+
+        return true;
+    };
+
+ public:
+    GraphFile()
+    {
+        data = NULL;
+        size = 0;
+        pos = 0;
+        bad = false;
+    };
+
+    // is the start of a file that of a binary graph file
+    static bool is_graph(const unsigned char *s, size_t n)
+    {
+        return n >= sizeof(graph_magic) - 1 &&
+            memcmp(s, graph_magic, sizeof(graph_magic) - 1) == 0;
+    };
+
+    // pass each graph of the file on to sink, false if it is malformed
+    bool read(GraphSink & sink, const unsigned char *d, size_t n)
+    {
+        data = d;
+        size = n;
+        pos = 0;
+        bad = false;
+
+        while (pos < size)
+        {
+            if (!record(sink))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    };
+};
+
+// read a binary graph file, if path is one, passing its graphs on to sink
+static bool read_graph_file(GraphSink & sink, const std::string & path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    bool is_graph = false;
+
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (map != MAP_FAILED)
+        {
+            const unsigned char *d = (const unsigned char *)map;
+            GraphFile file;
+
+            is_graph = GraphFile::is_graph(d, st.st_size);
+
+            if (is_graph && !file.read(sink, d, st.st_size))
+            {
+                munmap(map, st.st_size);
+                ::close(fd);
+                throw InputError(path, "malformed graph file");
+            }
+
+            munmap(map, st.st_size);
+        }
+    }
+
+    ::close(fd);
+
+    return is_graph;
+}
+
+// Process an input file, producing nodes and edges for each document in
+// it and passing them on to sink as each one is complete, timing each
+// phase in s, throwing InputError if it cannot be graphed
+static void read_documents(GraphSink & sink, std::string path,
+    const Options & opts, Stats & s)
+{
+    double t = now();
+
+    if (path != "-" && read_graph_file(sink, path))
+    {
+        s.parse += now() - t;
+        return;
+    }
+
+    Parser parser(path, opts);
+
+    parser.setStats(&s);
+    parser.open();
+    s.open += now() - t;
+
+    for (;;)
+    {
+        Nodes nodes;
+        Edges edges;
+
+        // read a document, producing nodes and edges, updating path
+        t = now();
+        parser.parse(nodes, edges);
+
+        bool more = parser.next_document(path);
+
+        s.parse += now() - t;
+
+        if (!more)
+        {
+            t = now();
+            parser.close(path);
+            s.close += now() - t;
+        }
+
+        t = now();
+        parser.finalize(nodes, edges);
+        run_passes(nodes, edges, opts);
+        s.finalize += now() - t;
+        s.documents++;
+        s.nodes += nodes.size();
+        s.edges += edges.size();
+
+        t = now();
+        sink.add(path, nodes, edges);
+        s.emit += now() - t;
+
+        if (!more)
+        {
+            break;
+        }
+    }
+}
+
+// read an input as read_documents does, false if it was given up on
+bool read_file(GraphSink & sink, std::string path, const Options & opts,
+    Stats * stats)
+{
+    Stats unused;
+    Stats & s = stats != NULL ? *stats : unused;
+
+    s.path = path;
+
+    try
+    {
+        read_documents(sink, path, opts, s);
+    }
+    catch(const InputError & e)
+    {
+        // a parse error names the line's object, not the input
+        s.failed = 1;
+        s.error = s.path + ": " + (!e.path.empty() && e.path != s.path ?
+            e.path + ": " : std::string()) + e.reason;
+        return false;
+    }
+
+    return true;
+}
+
+// report an input given up on, false if the rest are to be given up on
+// too, as they are unless keep_going
+static bool report_failure(const Stats & s, const Options & opts)
+{
+    std::cerr << s.error << std::endl;
+
+    return opts.keep_going;
+}
+
+// list the inputs given up on, after those graphed
+static void print_failures(std::ostream & out,
+    const std::vector < Stats > &inputs)
+{
+    std::vector < const Stats *>failed;
+
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+        if (inputs[i].failed > 0)
+        {
+            failed.push_back(&inputs[i]);
+        }
+    }
+
+    out << "lddgraph: " << failed.size() << " of " << inputs.size() <<
+        " inputs failed" << (failed.empty() ? "" : ":") << "\n";
+
+    for (size_t i = 0; i < failed.size(); i++)
+    {
+        out << "  " << failed[i]->error << "\n";
+    }
+
+    out << std::flush;
+}
+
+// report the statistics of each input and their totals, with the wall
+// time, the CPU time of lddgraph and of the ldd runs it waited for, and
+// peak resident set sizes
+static void print_stats(std::ostream & out, const std::vector < Stats > &inputs,
+    double wall, bool json)
+{
+    Stats total;
+    struct rusage self, children;
+    char s[512];
+
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &children);
+
+    std::string quoted;
+
+    out << (json ? "{\"inputs\": [" : "");
+
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+        total.add(inputs[i]);
+
+        if (json)
+        {
+            quoted.clear();
+            append_json(quoted, inputs[i].path);
+            out << (i > 0 ? ", " : "") << "{\"path\": " << quoted << ", ";
+            inputs[i].print(out, true);
+
+            if (inputs[i].failed > 0)
+            {
+                quoted.clear();
+                append_json(quoted, inputs[i].error);
+                out << ", \"error\": " << quoted;
+            }
+
+            out << "}";
+        }
+        else
+        {
+            out << "stats: " << inputs[i].path << ": ";
+            inputs[i].print(out, false);
+            out << (inputs[i].failed > 0 ? " error " + inputs[i].error : "") <<
+                "\n";
+        }
+    }
+
+    out << (json ? "], \"total\": {" : "stats: total: ");
+    total.print(out, json);
+
+    snprintf(s, sizeof(s), json ?
+        "}, \"wall\": %.6f, \"cpu\": %.6f, \"children_cpu\": %.6f, "
+        "\"peak_rss_kib\": %ld, \"children_peak_rss_kib\": %ld}\n" :
+        "\nstats: wall %.6fs cpu %.6fs children cpu %.6fs "
+        "peak rss %ld KiB children peak rss %ld KiB\n", wall,
+        self.ru_utime.tv_sec + self.ru_utime.tv_usec / 1e6 +
+        self.ru_stime.tv_sec + self.ru_stime.tv_usec / 1e6,
+        children.ru_utime.tv_sec + children.ru_utime.tv_usec / 1e6 +
+        children.ru_stime.tv_sec + children.ru_stime.tv_usec / 1e6,
+        self.ru_maxrss, children.ru_maxrss);
+    out << s << std::flush;
+}
+
+/*************************
+ *  Batch
+ *************************/
+
+// Batch processes many input files on a pool of worker threads. Each
+// graph is emitted, or passed on to a sink gathering them such as a union
+// graph, in input order as soon as it and all of the graphs before it are
+// complete.
+class Batch
+{
+ private:
+    // the work and result for one input
+    struct Job:public GraphSink
+    {
+        std::string path;       // input file
+        std::string text;       // graph text, if not merging, of the
+                                // documents read before any failure
+        std::vector < Document * >docs;     // graphs, if merging
+        bool done;              // result is complete
+        Stats stats;
+
+        void add(std::string & p, Nodes & nodes, Edges & edges)
+        {
+            Document *doc = new Document;
+
+            doc->path = p;
+            doc->nodes.swap(nodes);
+            doc->edges.swap(edges);
+            docs.push_back(doc);
+        };
+    };
+
+    std::vector < Job * >jobs;
+    const Options & opts;
+    GraphSink *merged;          // sink gathering the graphs, or NULL
+    size_t next;                // next input to be claimed by a worker
+    pthread_mutex_t lock;
+    pthread_cond_t completed;
+
+    // process a job on a worker, keeping its results for emit
+    void process(Job & job)
+    {
+        if (merged != NULL)
+        {
+            read_file(job, job.path, opts, &job.stats);
+            return;
+        }
+
+        std::ostringstream out;
+        PrintSink print(out, opts.format);
+        DiffSink diff(out, opts.format, opts.baseline);
+        GraphSink *sink = opts.baseline != NULL ? (GraphSink *) & diff : &print;
+
+        read_file(*sink, job.path, opts, &job.stats);
+        job.text = out.str();
+    };
+
+    // emit or merge a completed job, releasing its results, false if its
+    // failure gives up on the rest
+    bool emit(std::ostream & out, Job & job)
+    {
+        double t = now();
+
+        emit_job(out, job);
+        job.stats.emit += now() - t;
+
+        return job.stats.failed == 0 || report_failure(job.stats, opts);
+    };
+
+    void emit_job(std::ostream & out, Job & job)
+    {
+        if (merged != NULL)
+        {
+            for (size_t i = 0; i < job.docs.size(); i++)
+            {
+                Document *doc = job.docs[i];
+
+                merged->add(doc->path, doc->nodes, doc->edges);
+                delete doc;
+            }
+
+            job.docs.clear();
+            return;
+        }
+
+        out << job.text << std::flush;
+        std::string().swap(job.text);
+    };
+
+    static void *worker(void *arg)
+    {
+        Batch *batch = (Batch *) arg;
+
+        for (;;)
+        {
+            pthread_mutex_lock(&batch->lock);
+
+            size_t i = batch->next;
+
+            if (i < batch->jobs.size())
+            {
+                batch->next++;
+            }
+
+            pthread_mutex_unlock(&batch->lock);
+
+            if (i >= batch->jobs.size())
+            {
+                return NULL;
+            }
+
+            batch->process(*batch->jobs[i]);
+
+            pthread_mutex_lock(&batch->lock);
+            batch->jobs[i]->done = true;
+            pthread_cond_signal(&batch->completed);
+            pthread_mutex_unlock(&batch->lock);
+        }
+    };
+
+ public:
+    Batch(std::vector < std::string > &paths, const Options & o,
+        GraphSink * m):opts(o)
+    {
+        jobs.resize(paths.size());
+
+        for (size_t i = 0; i < paths.size(); i++)
+        {
+            jobs[i] = new Job;
+            jobs[i]->path = paths[i];
+            jobs[i]->done = false;
+        }
+
+        merged = m;
+        next = 0;
+        pthread_mutex_init(&lock, NULL);
+        pthread_cond_init(&completed, NULL);
+    };
+
+    ~Batch()
+    {
+        for (size_t i = 0; i < jobs.size(); i++)
+        {
+            delete jobs[i];
+        }
+
+        pthread_cond_destroy(&completed);
+        pthread_mutex_destroy(&lock);
+    };
+
+    // the statistics of each input, in input order
+    void getStats(std::vector < Stats > &stats)
+    {
+        for (size_t i = 0; i < jobs.size(); i++)
+        {
+            stats.push_back(jobs[i]->stats);
+        }
+    };
+
+    void run(std::ostream & out, unsigned int threads)
+    {
+        if (threads > jobs.size())
+        {
+            threads = jobs.size();
+        }
+
+        // a single thread needs no workers, and emits each document as
+        // it goes
+        if (threads <= 1)
+        {
+            PrintSink print(out, opts.format);
+            DiffSink diff(out, opts.format, opts.baseline);
+            GraphSink *sink = merged != NULL ? (GraphSink *) merged :
+                opts.baseline != NULL ? (GraphSink *) & diff : &print;
+
+            for (size_t i = 0; i < jobs.size(); i++)
+            {
+                if (!read_file(*sink, jobs[i]->path, opts, &jobs[i]->stats) &&
+                    !report_failure(jobs[i]->stats, opts))
+                {
+                    exit(EXIT_FAILURE);
+                }
+            }
+
+            return;
+        }
+
+        std::vector < pthread_t > tids(threads);
+
+        for (unsigned int t = 0; t < threads; t++)
+        {
+            int err = pthread_create(&tids[t], NULL, worker, this);
+
+            if (err != 0)
+            {
+                std::cerr << "pthread_create: " << strerror(err) << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        // emit in input order; on giving up, no more jobs are claimed,
+        // and the workers finish theirs before the process exits
+        bool given_up = false;
+
+        pthread_mutex_lock(&lock);
+
+        for (size_t i = 0; i < jobs.size() && !given_up; i++)
+        {
+            while (!jobs[i]->done)
+            {
+                pthread_cond_wait(&completed, &lock);
+            }
+
+            pthread_mutex_unlock(&lock);
+            given_up = !emit(out, *jobs[i]);
+            pthread_mutex_lock(&lock);
+
+            if (given_up)
+            {
+                next = jobs.size();
+            }
+        }
+
+        pthread_mutex_unlock(&lock);
+
+        for (unsigned int t = 0; t < threads; t++)
+        {
+            pthread_join(tids[t], NULL);
+        }
+
+        if (given_up)
+        {
+            exit(EXIT_FAILURE);
+        }
+    };
+};
+
+/*************************
+ *  Daemon
+ *************************/
+
+static volatile sig_atomic_t daemon_stop = 0;
+
+static void daemon_signal(int)
+{
+    daemon_stop = 1;
+}
+
+// Daemon answers graph requests on a Unix socket, keeping the object
+// cache and the responses in memory between requests. A request is one
+// line holding a root path, optionally preceded by a format and a space,
+// and the response is the graph, or a line starting "error:", after
+// which the connection is closed. Directories holding the objects of a
+// response are watched with inotify, and any change in them drops the
+// cached responses; the object cache revalidates itself by file identity.
+class Daemon
+{
+ private:
+    std::string socket_path;
+    const Options & opts;
+    int listen_fd;
+    int inotify_fd;
+    std::map < std::string, std::string > responses;    // request to reply
+    std::map < std::string, int >watches;      // directory to watch
+
+    // a sink which emits graphs and notes the directories of their nodes
+    class ResponseSink:public PrintSink
+    {
+     private:
+        Daemon & daemon;
+
+     public:
+        ResponseSink(std::ostream & o, Format f,
+            Daemon & d):PrintSink(o, f), daemon(d)
+        {
+        };
+
+        void add(std::string & path, Nodes & nodes, Edges & edges)
+        {
+            PrintSink::add(path, nodes, edges);
+
+            for (Nodes::iterator pn = nodes.begin(); pn != nodes.end(); ++pn)
+            {
+                const std::string & p = (*pn)->getPath();
+
+                if (p[0] == '/')
+                {
+                    daemon.watch(p.substr(0, p.rfind('/') + 1));
+                }
+            }
+        };
+    };
+
+    void watch(const std::string & dir)
+    {
+        if (watches.find(dir) != watches.end())
+        {
+            return;
+        }
+
+        int wd = inotify_add_watch(inotify_fd, host_path(opts, dir).c_str(),
+            IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_MOVED_FROM |
+            IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF);
+
+        if (wd < 0)
+        {
+            DEBUG_OUT(std::cerr << dir << ": inotify_add_watch: " <<
+                strerror(errno) << std::endl);
+        }
+
+        watches[dir] = wd;
+    };
+
+    // drop the cached responses if any watched directory changed
+    void read_events(void)
+    {
+        char buf[4096];
+        ssize_t n;
+        bool changed = false;
+
+        while ((n = read(inotify_fd, buf, sizeof(buf))) > 0)
         {
-            fp = stdin;
-            real_path_pending = true;
-            return;
+            changed = true;
         }
 
-        if (is_ELF_file(path))
+        if (changed)
         {
-            // executable files and files with .so in the name
-            std::string cmd("ldd -v ");
+            DEBUG_OUT(std::cerr << "dropping " << responses.size() <<
+                " responses" << std::endl);
+            responses.clear();
+        }
+    };
 
-            cmd += path;
+    // the reply to a request, from the cache if possible
+    std::string respond(const std::string & request)
+    {
+        std::map < std::string, std::string >::iterator pr =
+            responses.find(request);
 
-            fp = popen(cmd.c_str(), "r");
-            is_pipe = true;
+        if (pr != responses.end())
+        {
+            return pr->second;
         }
-        else if (access(path.c_str(), R_OK) == 0)
+
+        std::string path(request);
+        Format format = opts.format;
+        size_t space = path.find(' ');
+
+        if (space != std::string::npos &&
+            parse_format(path.substr(0, space), format))
         {
-            fp = fopen(path.c_str(), "r");
-            real_path_pending = true;
+            path = path.substr(space + 1);
         }
 
-        if (fp == NULL)
+        // only dynamically loaded files are graphed, not ldd -v text
+        ElfObject root;
+
+        if (path.empty())
         {
-            const char *operation = is_pipe ? "popen" : "fopen";
+            return "error: no path requested\n";
+        }
 
-            std::cerr << path << ": " << operation << ": " <<
-                strerror(errno) << std::endl;
-            exit(EXIT_FAILURE);
+        if (access(path.c_str(), R_OK) != 0)
+        {
+            return "error: " + path + ": " + strerror(errno) + "\n";
+        }
+
+        if (!read_object(opts, path, root) || !root.dynamic)
+        {
+            return "error: " + path + ": not a dynamically loaded file\n";
+        }
+
+        std::ostringstream out;
+        ResponseSink sink(out, format, *this);
+        Stats stats;
+
+        if (!read_file(sink, path, opts, &stats))
+        {
+            return "error: " + stats.error + "\n";
         }
+
+        return responses[request] = out.str();
     };
 
-    void parse(Nodes & nodes, Edges & edges)
+    void serve(int fd)
     {
-        // create a root node for the input file, also referred to as nodes[0]
-        cur_node = new Node(trim_front(path, "./"));
-        nodes.push_back(cur_node);
+        struct timeval tv = { 1, 0 };
+
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
 
-        // read and process lines until EOF
-        while (!feof(fp))
+        std::string request;
+        bool ended = false;
+        char c;
+
+        // a request is a line; one cut short by the client closing or
+        // stalling, or longer than any path, is not answered from
+        while (request.size() <= PATH_MAX && read(fd, &c, 1) == 1)
         {
-            if (process_line(nodes, edges) == false)
+            if (c == '\n')
             {
+                ended = true;
                 break;
             }
+
+            request += c;
+        }
+
+        request = trim_end(request, "\r");
+
+        std::string reply(ended ? respond(request) :
+            std::string("error: request not ended by a newline\n"));
+        const char *p = reply.data();
+        size_t left = reply.size();
+        ssize_t n;
+
+        while (left > 0 && (n = write(fd, p, left)) > 0)
+        {
+            p += n;
+            left -= n;
         }
     };
 
-    // note, updates the p argument with final path
-    // as output by ldd
-    void close(std::string & p)
+ public:
+    Daemon(std::string s, const Options & o):opts(o)
     {
-        // if error, quit while we're behind
-        if (!feof(fp))
+        socket_path = s;
+        listen_fd = -1;
+        inotify_fd = -1;
+    };
+
+    void run(void)
+    {
+        struct sockaddr_un addr;
+
+        if (socket_path.size() >= sizeof(addr.sun_path))
         {
-            std::cerr << path << ": aborted" << std::endl;
+            std::cerr << socket_path << ": socket path too long" << std::endl;
             exit(EXIT_FAILURE);
         }
 
-        if (is_pipe && pclose(fp) != 0)
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, socket_path.c_str());
+
+        listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        unlink(socket_path.c_str());
+
+        if (listen_fd < 0 ||
+            bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+            listen(listen_fd, SOMAXCONN) != 0)
         {
-            std::cerr << path << ": pclose:" << strerror(errno) << std::endl;
+            std::cerr << socket_path << ": " << strerror(errno) << std::endl;
             exit(EXIT_FAILURE);
         }
 
-        if (!is_pipe && fclose(fp) != 0)
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+        if (inotify_fd < 0)
         {
-            std::cerr << path.c_str() << ": fclose: " << strerror(errno) <<
-                std::endl;
+            std::cerr << "inotify_init1: " << strerror(errno) << std::endl;
             exit(EXIT_FAILURE);
         }
 
-        p = path;
-    };
+        // the search directories, where new objects can shadow old ones
+        const std::vector < std::string > &conf = ld_so_conf_dirs();
 
-    void finalize(Nodes & nodes, Edges & edges)
-    {
-        // Debug dump
-        for (Nodes::iterator pn = nodes.begin(); pn != nodes.end(); ++pn)
+        for (size_t i = 0; i < conf.size(); i++)
         {
-            (*pn)->dump();
+            watch(conf[i] + "/");
         }
 
-        for (Edges::iterator pe = edges.begin(); pe != edges.end(); ++pe)
+        watch("/lib/");
+        watch("/usr/lib/");
+
+        signal(SIGPIPE, SIG_IGN);
+        signal(SIGINT, daemon_signal);
+        signal(SIGTERM, daemon_signal);
+
+        while (!daemon_stop)
         {
-            (*pe)->dump();
+            struct pollfd fds[2];
+
+            fds[0].fd = listen_fd;
+            fds[0].events = POLLIN;
+            fds[1].fd = inotify_fd;
+            fds[1].events = POLLIN;
+
+            if (poll(fds, 2, -1) < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+
+                std::cerr << "poll: " << strerror(errno) << std::endl;
+                break;
+            }
+
+            // apply changes before answering from the cache
+            if (fds[1].revents & POLLIN)
+            {
+                read_events();
+            }
+
+            if (fds[0].revents & POLLIN)
+            {
+                int fd = accept(listen_fd, NULL, NULL);
+
+                if (fd >= 0)
+                {
+                    read_events();
+                    serve(fd);
+                    ::close(fd);
+                }
+            }
         }
 
-        trim_unlabeled_edges(edges);
+        ::close(listen_fd);
+        ::close(inotify_fd);
+        unlink(socket_path.c_str());
     };
 };
 
-void print_output(std::string & path, Nodes & nodes, Edges & edges)
+// read input file paths, one per line, from a file or - for stdin
+static void read_path_list(const char *list, std::vector < std::string > &paths)
 {
-    // Begin output file on stdout
-    std::cout << "digraph G {" << std::endl;
-    std::cout << "info_block [shape=box, label=\"" << "file: " << path <<
-        "\\n" << "nodes: " << nodes.size() << "\\n" << "edges: " <<
-        edges.size() << "\"];" << std::endl;
+    std::ifstream file;
+    bool is_stdin = strcmp(list, "-") == 0;
 
-    // For each node, emit a digraph node
-    for (Nodes::iterator pn = nodes.begin(); pn != nodes.end(); ++pn)
+    if (!is_stdin)
     {
-        std::cout << (*pn)->getPathQuoted() << ";" << std::endl;
+        file.open(list);
+
+        if (!file)
+        {
+            std::cerr << list << ": open: " << strerror(errno) << std::endl;
+            exit(EXIT_FAILURE);
+        }
     }
 
-    // Emit all edges
+    std::istream & in = is_stdin ? std::cin : file;
+    std::string line;
 
-    for (Edges::iterator pe = edges.begin(); pe != edges.end(); ++pe)
+    while (std::getline(in, line))
     {
-        // emit the basic digraph edge
-        std::cout << (*pe)->getFrom()->getPathQuoted() << " -> " <<
-            (*pe)->getTo()->getPathQuoted();
+        if (!line.empty())
+        {
+            paths.push_back(line);
+        }
+    }
+}
 
-        // make the digraph edge solid if labeled, and dotted if not.
+/*************************
+ *  Main
+ *************************/
+
+static void usage(void)
+{
+    std::cerr <<
+        "usage: lddgraph [-ckKlmsStux] [-j jobs] [-f path-list] [-C cache-file]"
+        << std::endl <<
+        "                [-o dot|binary|json|tsv] [-p runs] [-D previous-graph]"
+        << std::endl <<
+        "                [-L depth] [-i glob] [-e glob] [-F glob] [--stats[=json]]"
+        << std::endl <<
+        "                [--sysroot=image-root | -a image-archive ...]" <<
+        std::endl <<
+        "                [--ldd-jobs=n] [--timeout=seconds]" << std::endl <<
+        "                { - | ldd-output-file | dynamically-loadable-file } ..."
+        << std::endl <<
+        "       lddgraph [-C cache-file] [--sysroot=image-root] -d socket" <<
+        std::endl <<
+        "       lddgraph [-o json] -I index-file -q name ..." << std::endl;
+    exit(EXIT_FAILURE);
+}
+
+static int command(int ac, char **av)
+{
+    static const struct option long_options[] = {
+        {"ldd", no_argument, NULL, 'l'},
+        {"union", no_argument, NULL, 'u'},
+        {"multiple", no_argument, NULL, 'm'},
+        {"jobs", required_argument, NULL, 'j'},
+        {"files-from", required_argument, NULL, 'f'},
+        {"cache", required_argument, NULL, 'C'},
+        {"daemon", required_argument, NULL, 'd'},
+        {"format", required_argument, NULL, 'o'},
+        {"symbols", no_argument, NULL, 's'},
+        {"symbol-names", no_argument, NULL, 'S'},
+        {"cost", no_argument, NULL, 'c'},
+        {"profile", required_argument, NULL, 'p'},
+        {"stats", optional_argument, NULL, 'T'},
+        {"diff", required_argument, NULL, 'D'},
+        {"index", required_argument, NULL, 'I'},
+        {"query", required_argument, NULL, 'q'},
+        {"collapse-cycles", no_argument, NULL, 'k'},
+        {"reduce", no_argument, NULL, 't'},
+        {"dominators", no_argument, NULL, 'x'},
+        {"max-depth", required_argument, NULL, 'L'},
+        {"include", required_argument, NULL, 'i'},
+        {"exclude", required_argument, NULL, 'e'},
+        {"fold", required_argument, NULL, 'F'},
+        {"sysroot", required_argument, NULL, 'R'},
+        {"archive", required_argument, NULL, 'a'},
+        {"ldd-jobs", required_argument, NULL, 'J'},
+        {"timeout", required_argument, NULL, 'W'},
+        {"keep-going", no_argument, NULL, 'K'},
+        {"help", no_argument, NULL, '?'},
+        {NULL, 0, NULL, 0}
+    };
+    Options opts;
+    bool merge = false;
+    unsigned int jobs = 1;
+    std::vector < std::string > paths;
+    const char *socket_path = NULL;
+    const char *baseline_path = NULL;
+    const char *index_path = NULL;
+    std::vector < std::string > queries;
+    std::vector < std::string > archives;
+    int stats = 0;              // 1 for text, 2 for JSON
+    double start = now();
+    int c;
+    char *end;
+
+    // output goes through std::cout alone, so it needs no stdio syncing
+    std::ios::sync_with_stdio(false);
+
+    while ((c = getopt_long(ac, av, "lumsScktxKj:f:C:d:o:p:D:I:q:L:i:e:F:a:?", long_options, NULL)) != -1)
+    {
+        switch (c)
+        {
+            case 'l':
+                opts.use_ldd = true;
+                break;
+            case 'u':
+                merge = true;
+                break;
+            case 'm':
+                opts.split_documents = true;
+                break;
+            case 's':
+                opts.symbols = std::max(opts.symbols, 1);
+                break;
+            case 'S':
+                opts.symbols = 2;
+                break;
+            case 'c':
+                opts.cost = 1;
+                break;
+            case 'k':
+                opts.collapse_cycles = true;
+                break;
+            case 't':
+                opts.reduce = true;
+                break;
+            case 'x':
+                opts.dominators = true;
+                break;
+            case 'K':
+                opts.keep_going = true;
+                break;
+            case 'L':
+                opts.max_depth = strtol(optarg, &end, 10);
+
+                if (*optarg == '\0' || *end != '\0' || opts.max_depth < 0)
+                {
+                    usage();
+                }
+                break;
+            case 'i':
+                opts.include.push_back(optarg);
+                break;
+            case 'e':
+                opts.exclude.push_back(optarg);
+                break;
+            case 'F':
+                opts.fold.push_back(optarg);
+                break;
+            case 'a':
+                archives.push_back(optarg);
+                break;
+            case 'J':
+                opts.ldd_jobs = strtoul(optarg, &end, 10);
+
+                if (*optarg == '\0' || *end != '\0' || opts.ldd_jobs == 0)
+                {
+                    usage();
+                }
+                break;
+            case 'W':
+                opts.ldd_timeout = strtod(optarg, &end);
+
+                if (*optarg == '\0' || *end != '\0' || opts.ldd_timeout <= 0)
+                {
+                    usage();
+                }
+                break;
+            case 'R':
+                {
+                    char real[PATH_MAX];
+
+                    if (realpath(optarg, real) == NULL)
+                    {
+                        std::cerr << optarg << ": " << strerror(errno) <<
+                            std::endl;
+                        exit(EXIT_FAILURE);
+                    }
+
+                    // the host root is no image
+                    opts.sysroot = strcmp(real, "/") == 0 ? "" : real;
+                }
+                break;
+            case 'T':
+                if (optarg != NULL && strcmp(optarg, "json") != 0)
+                {
+                    usage();
+                }
+
+                stats = optarg != NULL ? 2 : 1;
+                break;
+            case 'p':
+                opts.profile_runs = strtoul(optarg, &end, 10);
+
+                if (*optarg == '\0' || *end != '\0' || opts.profile_runs == 0)
+                {
+                    usage();
+                }
+                break;
+            case 'j':
+                jobs = strtoul(optarg, &end, 10);
+
+                if (*optarg == '\0' || *end != '\0')
+                {
+                    usage();
+                }
+
+                // -j 0 is one job per online processor
+                if (jobs == 0)
+                {
+                    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+                    jobs = n > 0 ? n : 1;
+                }
+                break;
+            case 'f':
+                read_path_list(optarg, paths);
+                break;
+            case 'C':
+                delete opts.cache;
+                opts.cache = new ObjectCache(optarg);
+                break;
+            case 'd':
+                socket_path = optarg;
+                break;
+            case 'D':
+                baseline_path = optarg;
+                break;
+            case 'I':
+                index_path = optarg;
+                break;
+            case 'q':
+                queries.push_back(optarg);
+                break;
+            case 'o':
+                if (!parse_format(optarg, opts.format))
+                {
+                    usage();
+                }
+                break;
+            default:
+                usage();
+        }
+    }
+
+    for (int i = optind; i < ac; i++)
+    {
+        paths.push_back(av[i]);
+    }
 
-        if ((*pe)->isLabeled())
+    // answer queries from the index alone
+    if (!queries.empty())
+    {
+        if (index_path == NULL || !paths.empty() || socket_path != NULL)
         {
-            std::string labels = (*pe)->getLabels("\\n");
-            std::cout << " [label=\"" << labels << "\"]";
+            usage();
         }
-        else
+
+        IndexFile index;
+
+        if (!index.open(index_path))
         {
-            std::cout << " [style=dotted]";
+            std::cerr << index_path << ": cannot read index" << std::endl;
+            exit(EXIT_FAILURE);
         }
 
-        std::cout << ";" << std::endl;
+        exit(query_index(std::cout, index, queries, opts.format) ?
+            EXIT_SUCCESS : EXIT_FAILURE);
     }
 
-    // constrain output location of info block
-    if (edges.size() > 0)
+    // emit usage if no file arguments, or file arguments to a daemon
+    if ((paths.empty() && archives.empty()) == (socket_path == NULL))
     {
-        std::cout << edges[0]->getTo()->getPathQuoted() <<
-            " -> info_block [style=invis];" << std::endl;
+        usage();
     }
 
-    // end digraph output
-    std::cout << "}" << std::endl;
-}
+    // ldd and profiles run the image's loader, which is what --sysroot
+    // does without
+    if (!opts.sysroot.empty() && (opts.use_ldd || opts.profile_runs > 0))
+    {
+        usage();
+    }
 
-/*************************
- *  Main helpers
- *************************/
+    // archived images keep no symbol tables, and there is nothing on
+    // disk for a daemon to watch
+    if (!archives.empty() && (!opts.sysroot.empty() || opts.use_ldd ||
+            opts.profile_runs > 0 || opts.symbols > 0 || opts.cost > 0 ||
+            socket_path != NULL))
+    {
+        usage();
+    }
 
-// Process an input file, producing a directed graph description on output
-void read_file(std::string path)
-{
-    Parser parser(path);
-    Nodes nodes;
-    Edges edges;
+    ImageArchive image;
 
-    // read the input file, producing nodes and edges, updating path
-    parser.open();
-    parser.parse(nodes, edges);
-    parser.close(path);
-    parser.finalize(nodes, edges);
+    for (size_t i = 0; i < archives.size(); i++)
+    {
+        if (!image.read(archives[i]))
+        {
+            exit(EXIT_FAILURE);
+        }
 
-    print_output(path, nodes, edges);
-}
+        opts.image = &image;
+    }
 
-/*************************
- *  Main
- *************************/
+    // without paths in the image, graph each of its executables
+    if (opts.image != NULL && paths.empty())
+    {
+        image.executables(paths);
 
-int main(int ac, char **av)
-{
-    // emit usage if:
-    //  * no arguments
-    //  * first argument has - followed by another letter
-    if (ac < 2 || (ac > 1 && (av[1])[0] == '-' && (av[1])[1] != '\0'))
+        if (paths.empty())
+        {
+            std::cerr << archives.back() <<
+                ": no dynamically linked executables" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    set_ld_so_image(opts);
+
+    // changes are reported per root, in a text format
+    if (baseline_path != NULL && (merge || socket_path != NULL ||
+            index_path != NULL || opts.format == FORMAT_BINARY))
+    {
+        usage();
+    }
+
+    if (socket_path != NULL && opts.cache == NULL)
+    {
+        opts.cache = new ObjectCache("");
+    }
+
+    if (opts.cache != NULL)
+    {
+        opts.cache->load();
+    }
+
+    if (socket_path != NULL)
+    {
+        Daemon daemon(socket_path, opts);
+
+        daemon.run();
+        opts.cache->save();
+        exit(EXIT_SUCCESS);
+    }
+
+    Baseline baseline;
+
+    if (baseline_path != NULL)
+    {
+        // the earlier graph is a file on the host, not in the image
+        Options host(opts);
+
+        host.image = NULL;
+
+        Stats stats;
+
+        if (!read_file(baseline, baseline_path, host, &stats))
+        {
+            report_failure(stats, host);
+            exit(EXIT_FAILURE);
+        }
+
+        opts.baseline = &baseline;
+    }
+
+    // threads not needed for separate inputs read objects for each input
+    opts.load_threads = jobs > paths.size() ? jobs / paths.size() : 1;
+
+    // ldd -v runs ahead of the parse, by default as many at once as
+    // there are jobs
+    LddPool ldd_pool(opts.ldd_jobs > 0 ? opts.ldd_jobs : jobs,
+        opts.ldd_timeout);
+
+    if (opts.use_ldd)
+    {
+        ldd_pool.start(paths);
+        opts.ldd = &ldd_pool;
+    }
+
+    // iterate over input files, gathering their graphs into the index
+    // or the union graph, or both
+    Graph graph;
+    ReverseIndex index(merge ? &graph : NULL);
+    GraphSink *gather = index_path != NULL ? (GraphSink *) & index :
+        merge ? &graph : NULL;
+    Batch batch(paths, opts, gather);
+
+    batch.run(std::cout, jobs);
+
+    std::vector < Stats > inputs;
+
+    batch.getStats(inputs);
+
+    if (index_path != NULL && !index.write(index_path))
     {
-        std::cerr <<
-            "usage: lddgraph { - | ldd-output-file | dynamically-loadable-file }"
-            << std::endl;
         exit(EXIT_FAILURE);
     }
 
-    // iterate over input files
-    while (--ac > 0)
+    if (merge)
+    {
+        std::string path("union");
+
+        run_passes(graph.getNodes(), graph.getEdges(), opts);
+        print_graph(std::cout, opts.format, path, graph.getInfo(),
+            graph.getNodes(), graph.getEdges());
+    }
+
+    if (opts.cache != NULL)
+    {
+        opts.cache->save();
+    }
+
+    if (stats > 0)
+    {
+        std::cout << std::flush;
+        print_stats(std::cerr, inputs, now() - start, stats == 2);
+    }
+
+    // with --keep-going, the inputs given up on are summed up at the end
+    Stats total;
+
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+        total.add(inputs[i]);
+    }
+
+    if (total.failed > 0)
     {
-        read_file(*++av);
+        std::cout << std::flush;
+        print_failures(std::cerr, inputs);
+        exit(EXIT_FAILURE);
     }
 
     exit(EXIT_SUCCESS);
 }
+
+int run_main(int ac, char **av)
+{
+    // what only a whole run can fail on, such as a full string table
+    try
+    {
+        return command(ac, av);
+    }
+    catch(const InputError & e)
+    {
+        std::cerr << (e.path.empty() ? "" : e.path + ": ") << e.reason <<
+            std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+}                               // namespace lddgraph
@@ -0,0 +1,217 @@
+/*
+ * lddgraph.h - lddgraph as a library: read executables, shared objects,
+ * ldd -v output and binary graph files into the graph of each document,
+ * passing them on to a GraphSink in the calling process, with an object
+ * cache that can be shared by every read
+ */
+
+/*
+ * Copyright 2021 James Perkins
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef LDDGRAPH_LDDGRAPH_H
+#define LDDGRAPH_LDDGRAPH_H
+
+// C++ APIs
+#include <iostream>             // std::ostream
+#include <string>               // std::string
+#include <vector>               // std::vector
+
+// C APIs
+#include <stdint.h>             // uint64_t
+#include <stdio.h>              // snprintf
+
+#include "graph.h"
+#include "emit.h"
+
+namespace lddgraph
+{
+
+/*************************
+ *  Statistics
+ *************************/
+
+// Stats counts the time and work spent on an input, for --stats
+struct Stats
+{
+    std::string path;
+    double open;                // seconds opening, or running ldd
+    double parse;               // reading ldd output or ELF files
+    double close;               // closing
+    double finalize;            // trimming edges
+    double emit;                // writing or merging graphs
+    uint64_t lines;             // ldd output lines parsed
+    uint64_t documents;
+    uint64_t nodes;
+    uint64_t edges;
+    uint64_t lookups;           // candidate files tried by the loader
+    uint64_t failed;            // inputs given up on
+    std::string error;          // the path and reason it was given up on
+
+    Stats()
+    {
+        open = parse = close = finalize = emit = 0;
+        lines = documents = nodes = edges = lookups = failed = 0;
+    };
+
+    void add(const Stats & s)
+    {
+        open += s.open;
+        parse += s.parse;
+        close += s.close;
+        finalize += s.finalize;
+        emit += s.emit;
+        lines += s.lines;
+        documents += s.documents;
+        nodes += s.nodes;
+        edges += s.edges;
+        lookups += s.lookups;
+        failed += s.failed;
+    };
+
+    void print(std::ostream & out, bool json) const
+    {
+        char s[512];
+
+        snprintf(s, sizeof(s), json ?
+            "\"open\": %.6f, \"parse\": %.6f, \"close\": %.6f, "
+            "\"finalize\": %.6f, \"emit\": %.6f, \"lines\": %llu, "
+            "\"documents\": %llu, \"nodes\": %llu, \"edges\": %llu, "
+            "\"lookups\": %llu, \"failed\": %llu" :
+            "open %.6fs parse %.6fs close %.6fs finalize %.6fs emit %.6fs "
+            "lines %llu documents %llu nodes %llu edges %llu lookups %llu "
+            "failed %llu",
+            open, parse, close, finalize, emit, (unsigned long long)lines,
+            (unsigned long long)documents, (unsigned long long)nodes,
+            (unsigned long long)edges, (unsigned long long)lookups,
+            (unsigned long long)failed);
+        out << s;
+    };
+};
+
+/*************************
+ *  Options
+ *************************/
+
+class Baseline;
+class ImageArchive;
+class LddPool;
+class ObjectCache;
+
+// settings shared by every input
+struct Options
+{
+    bool use_ldd;               // run ELF files through ldd -v
+    bool split_documents;       // ldd -v text may hold many documents
+    ObjectCache *cache;         // object cache, or NULL
+    Format format;              // graph output format
+    unsigned int load_threads;  // threads reading the objects of a root
+    int symbols;                // 1 to count bound symbols, 2 to name them
+    int cost;                   // 1 to measure load costs
+    unsigned int profile_runs;  // times to run executables for profiles
+    const Baseline *baseline;   // graphs to report changes since, or NULL
+    bool collapse_cycles;       // join each cycle of objects into a node
+    bool reduce;                // drop edges implied by longer paths
+    bool dominators;            // find the dominator of each object
+    int max_depth;              // needs followed from the root, or -1
+    std::vector < std::string > include;        // names to follow, if any
+    std::vector < std::string > exclude;        // names not to follow
+    std::vector < std::string > fold;   // names to fold into one node each
+    std::string sysroot;        // image root objects are found in, or ""
+    const ImageArchive *image;  // archived image objects are found in
+    LddPool *ldd;               // runs ldd -v ahead of the parse, or NULL
+    unsigned int ldd_jobs;      // ldd -v children at once, 0 for jobs
+    double ldd_timeout;         // seconds before ldd -v is killed, or 0
+    bool keep_going;            // carry on past inputs that fail
+
+    Options()
+    {
+        use_ldd = false;
+        split_documents = false;
+        cache = NULL;
+        format = FORMAT_DOT;
+        load_threads = 1;
+        symbols = 0;
+        cost = 0;
+        profile_runs = 0;
+        baseline = NULL;
+        collapse_cycles = false;
+        reduce = false;
+        dominators = false;
+        max_depth = -1;
+        image = NULL;
+        ldd = NULL;
+        ldd_jobs = 0;
+        ldd_timeout = 0;
+        keep_going = false;
+    };
+};
+
+/*************************
+ *  Reading inputs
+ *************************/
+
+// InputError is thrown within read_file when an input cannot be graphed,
+// naming it and what went wrong; read_file records it in the input's
+// Stats, and the caller gives up or carries on with the next input
+struct InputError
+{
+    std::string path;
+    std::string reason;
+
+    InputError(const std::string & p, const std::string & r):path(p),
+        reason(r)
+    {
+    };
+};
+
+// Process an input file, producing nodes and edges for each document in
+// it and passing them on to sink as each one is complete, and timing each
+// phase in stats if it isn't NULL; false if it was given up on, with the
+// error in stats. The documents passed on before then are kept. Inputs
+// may be read on many threads at once with the same options.
+bool read_file(GraphSink & sink, std::string path, const Options & opts,
+    Stats * stats = NULL);
+
+// run the graph passes the options ask for on a finished graph
+void run_passes(Nodes & nodes, Edges & edges, const Options & opts);
+
+// the image whose ld.so configuration needed objects are searched by, from
+// the sysroot or archived image of opts; set once, before the first read
+void set_ld_so_image(const Options & opts);
+
+// an object cache kept in file, or in memory alone if file is "", loaded
+// from it; given in Options::cache it is shared by every read_file using
+// those options, and objects read again are looked up in it
+ObjectCache *open_object_cache(const std::string & file);
+
+// write an object cache back to its file
+void save_object_cache(ObjectCache * cache);
+
+// free an object cache, once no read_file is using it
+void close_object_cache(ObjectCache * cache);
+
+// run lddgraph(1) with a command line, exiting
+int run_main(int ac, char **av);
+
+}                               // namespace lddgraph
+
+#endif